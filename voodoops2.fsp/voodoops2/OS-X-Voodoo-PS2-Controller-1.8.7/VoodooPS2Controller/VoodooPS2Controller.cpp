@@ -45,6 +45,16 @@ static const IOPMPowerState PS2PowerStateArray[ kPS2PowerStateCount ] =
     { 1,kIOPMDeviceUsable, IOPMPowerOn, IOPMPowerOn, 0,0,0,0,0,0,0,0 }
 };
 
+// _readState, hand-off of one byte between waitForDataPort and the
+// primary interrupt handlers (see completePendingRead)
+enum
+{
+    kReadIdle = 0,      // nobody waiting
+    kReadWaiting,       // request asleep, next interrupt should read the port
+    kReadBusy,          // port being read (by either side)
+    kReadDone           // _readByte/_readStatus valid
+};
+
 // =============================================================================
 // Interrupt-Time Support Functions
 //
@@ -54,7 +64,11 @@ void ApplePS2Controller::interruptHandlerMouse(OSObject*, void* refCon, IOServic
 {
   ApplePS2Controller* me = (ApplePS2Controller*)refCon;
   if (me->_ignoreInterrupts)
+  {
+    // a request may be asleep waiting for this byte
+    me->completePendingRead();
     return;
+  }
     
   //
   // Wake our workloop to service the interrupt.    This is an edge-triggered
@@ -75,7 +89,11 @@ void ApplePS2Controller::interruptHandlerKeyboard(OSObject*, void* refCon, IOSer
 {
   ApplePS2Controller* me = (ApplePS2Controller*)refCon;
   if (me->_ignoreInterrupts)
+  {
+    // a request may be asleep waiting for this byte
+    me->completePendingRead();
     return;
+  }
     
 #if DEBUGGER_SUPPORT
   //
@@ -320,6 +338,10 @@ bool ApplePS2Controller::init(OSDictionary* dict)
     
   _wakedelay = 10;
   _cmdGate = 0;
+  _interruptReads = false;
+  _commandByteIRQs = 0;
+  _readState = kReadIdle;
+  _requestThread = 0;
     
   _requestQueueLock = 0;
   _cmdbyteLock = 0;
@@ -378,6 +400,13 @@ IOReturn ApplePS2Controller::setPropertiesGated(OSObject* props)
         setProperty("WakeDelay", _wakedelay, 32);
     }
     
+    // get InterruptDrivenReads
+    if (OSBoolean* flag = OSDynamicCast(OSBoolean, dict->getObject("InterruptDrivenReads")))
+    {
+        _interruptReads = flag->isTrue();
+        setProperty("InterruptDrivenReads", _interruptReads);
+    }
+    
     return kIOReturnSuccess;
 }
 
@@ -397,6 +426,7 @@ IOReturn ApplePS2Controller::setProperties(OSObject* props)
 
 void ApplePS2Controller::resetController(void)
 {
+    bool owner = enterRequest();
     _suppressTimeout = true;
     UInt8 commandByte;
     
@@ -440,6 +470,7 @@ void ApplePS2Controller::resetController(void)
     commandByte |= kCB_TranslateMode;
     writeCommandPort(kCP_SetCommandByte);
     writeDataPort(commandByte);
+    _commandByteIRQs = commandByte & (kCB_EnableKeyboardIRQ | kCB_EnableMouseIRQ);
     DEBUG_LOG("%s: new commandByte = %02x\n", getName(), commandByte);
     
     writeDataPort(kDP_SetDefaultsAndDisable);
@@ -460,6 +491,7 @@ void ApplePS2Controller::resetController(void)
         inb(kDataPort);
         IODelay(kDataDelay);
     }
+    leaveRequest(owner);
 }
 
 // -- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -882,6 +914,7 @@ void ApplePS2Controller::setCommandByteGated(PS2Request* request)
 {
     UInt8 setBits = request->commands[0].setBits;
     UInt8 clearBits = request->commands[0].clearBits;
+    bool owner = enterRequest();
     ++_ignoreInterrupts;
     writeCommandPort(kCP_GetCommandByte);
     UInt8 oldCommandByte = readDataPort(kDT_Keyboard);
@@ -893,7 +926,9 @@ void ApplePS2Controller::setCommandByteGated(PS2Request* request)
         DEBUG_LOG("%s: newCommandByte = %02x\n", getName(), newCommandByte);
         writeCommandPort(kCP_SetCommandByte);
         writeDataPort(newCommandByte);
+        _commandByteIRQs = newCommandByte & (kCB_EnableKeyboardIRQ | kCB_EnableMouseIRQ);
     }
+    leaveRequest(owner);
     request->commands[0].oldBits = oldCommandByte;
 }
 
@@ -1057,6 +1092,7 @@ void ApplePS2Controller::processRequest(PS2Request * request)
   bool          failed          = false;
   bool          transmitToMouse = false;
   unsigned      index;
+  bool          owner           = enterRequest();
 
   if (_hardwareOffline)
   {
@@ -1163,8 +1199,10 @@ void ApplePS2Controller::processRequest(PS2Request * request)
       case kPS2C_ModifyCommandByte:
         writeCommandPort(kCP_GetCommandByte);
         UInt8 commandByte = readDataPort(kDT_Keyboard);
+        UInt8 newCommandByte = (commandByte | request->commands[index].setBits) & ~request->commands[index].clearBits;
         writeCommandPort(kCP_SetCommandByte);
-        writeDataPort((commandByte | request->commands[index].setBits) & ~request->commands[index].clearBits);
+        writeDataPort(newCommandByte);
+        _commandByteIRQs = newCommandByte & (kCB_EnableKeyboardIRQ | kCB_EnableMouseIRQ);
         request->commands[index].oldBits = commandByte;
         break;
     }
@@ -1178,6 +1216,8 @@ void ApplePS2Controller::processRequest(PS2Request * request)
     
 hardware_offline:
 
+  leaveRequest(owner);
+
   // If a command failed and stopped the request processing, store its
   // index into the commandsCount field.
 
@@ -1259,20 +1299,12 @@ UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType)
 #endif //DEBUGGER_SUPPORT
 
     //
-    // Wait for the controller's output buffer to become ready.
+    // Wait for the controller's output buffer to become ready and read in
+    // the data.  If we timed out, something went awfully wrong; return a
+    // fake value.
     //
 
-    while (timeoutCounter && !((status = inb(kCommandPort)) & kOutputReady))
-    {
-      timeoutCounter--;
-      IODelay(kDataDelay);
-    }
-
-    //
-    // If we timed out, something went awfully wrong; return a fake value.
-    //
-
-    if (timeoutCounter == 0)
+    if (!waitForDataPort(deviceType, timeoutCounter, &status, &readByte))
     {
 #if DEBUGGER_SUPPORT
       unlockController(state);  // (release interrupt lockout + access to queue)
@@ -1285,20 +1317,10 @@ UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType)
     }
 
     //
-    // For older machines, it is necessary to wait a while after the controller
-    // has asserted the output buffer bit before reading the data port. No more
-    // data will be available if this wait is not performed.
-    //
-
-    IODelay(kDataDelay);
-
-    //
-    // Read in the data.  We return the data, however, only if it arrived on
-    // the requested input stream.
+    // We return the data, however, only if it arrived on the requested input
+    // stream.
     //
 
-    readByte = inb(kDataPort);
-
 #if DEBUGGER_SUPPORT
     unlockController(state);    // (release interrupt lockout + access to queue)
 #endif //DEBUGGER_SUPPORT
@@ -1381,22 +1403,14 @@ UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType,
 #endif //DEBUGGER_SUPPORT
 
     //
-    // Wait for the controller's output buffer to become ready.
+    // Wait for the controller's output buffer to become ready and read in
+    // the data.  If we timed out, we return the first byte we read, unless
+    // THIS IS the first byte we are trying to read,  then something went
+    // awfully wrong and we return a fake value rather than lock up the
+    // controller longer.
     //
 
-    while (timeoutCounter && !((status = inb(kCommandPort)) & kOutputReady))
-    {
-      timeoutCounter--;
-      IODelay(kDataDelay);
-    }
-
-    //
-    // If we timed out, we return the first byte we read, unless THIS IS the
-    // first byte we are trying to read,  then something went awfully wrong
-    // and we return a fake value rather than lock up the controller longer.
-    //
-
-    if (timeoutCounter == 0)
+    if (!waitForDataPort(deviceType, timeoutCounter, &status, &readByte))
     {
 #if DEBUGGER_SUPPORT
       unlockController(state);  // (release interrupt lockout + access to queue)
@@ -1410,19 +1424,10 @@ UInt8 ApplePS2Controller::readDataPort(PS2DeviceType deviceType,
     }
 
     //
-    // For older machines, it is necessary to wait a while after the controller
-    // has asserted the output buffer bit before reading the data port. No more
-    // data will be available if this wait is not performed.
-    //
-
-    IODelay(kDataDelay);
-
-    //
-    // Read in the data.  We process the data, however, only if it arrived on
-    // the requested input stream.
+    // We process the data, however, only if it arrived on the requested
+    // input stream.
     //
 
-    readByte        = inb(kDataPort);
     requestedStream = false;
 
     if ( (status & kMouseData) )
@@ -1505,6 +1510,161 @@ skipForwardToY:
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+bool ApplePS2Controller::waitForDataPort(PS2DeviceType deviceType,
+                                         UInt32&       timeoutCounter,
+                                         UInt8*        status,
+                                         UInt8*        readByte)
+{
+  //
+  // Waits for the controller's output buffer to become ready and reads the
+  // data byte.  Returns false if nothing arrived within (timeoutCounter X
+  // kDataDelay) microseconds.  timeoutCounter is updated, so a caller that
+  // reads several bytes keeps one overall timeout.
+  //
+  // With InterruptDrivenReads the thread sleeps in the command gate and the
+  // primary interrupt handler reads the byte (see completePendingRead).  It
+  // sleeps in slices of kReadSliceMS and polls the controller once at the
+  // start of each slice, so an interrupt that came before we were waiting
+  // costs at most one slice.  Startup, streams without an installed
+  // interrupt handler, streams whose IRQ is off in the command byte (sleep
+  // and wake run their device commands that way) and debugger support
+  // busy-poll as before; no interrupt would end their slices early.
+  //
+  // This method should only be called from our single-threaded work loop.
+  //
+
+#if !DEBUGGER_SUPPORT
+  bool installed = (deviceType == kDT_Mouse) ? _interruptInstalledMouse : _interruptInstalledKeyboard;
+  UInt8 irq = (deviceType == kDT_Mouse) ? kCB_EnableMouseIRQ : kCB_EnableKeyboardIRQ;
+  if (_interruptReads && installed && (_commandByteIRQs & irq) && !_suppressTimeout && _workLoop && _workLoop->inGate())
+  {
+    const UInt32 sliceCount = kReadSliceMS * 1000 / kDataDelay;
+
+    OSCompareAndSwap(kReadIdle, kReadWaiting, &_readState);
+    while (1)
+    {
+      // claim the port and see if the data is already there
+      if (OSCompareAndSwap(kReadWaiting, kReadBusy, &_readState))
+      {
+        UInt8 s = inb(kCommandPort);
+        if (s & kOutputReady)
+        {
+          IODelay(kDataDelay);
+          *readByte = inb(kDataPort);
+          *status   = s;
+          OSCompareAndSwap(kReadBusy, kReadIdle, &_readState);
+          return true;
+        }
+        if (timeoutCounter == 0)
+        {
+          OSCompareAndSwap(kReadBusy, kReadIdle, &_readState);
+          return false;
+        }
+        OSCompareAndSwap(kReadBusy, kReadWaiting, &_readState);
+      }
+
+      if (_readState != kReadDone)
+      {
+        uint64_t deadline;
+        clock_interval_to_deadline(kReadSliceMS, kMillisecondScale, &deadline);
+        _cmdGate->commandSleep((void*)&_readState, *(AbsoluteTime*)&deadline, THREAD_UNINT);
+        timeoutCounter = (timeoutCounter > sliceCount) ? timeoutCounter - sliceCount : 0;
+      }
+
+      // the interrupt handler read it for us
+      if (OSCompareAndSwap(kReadDone, kReadIdle, &_readState))
+      {
+        *readByte = _readByte;
+        *status   = _readStatus;
+        return true;
+      }
+    }
+  }
+#endif //!DEBUGGER_SUPPORT
+
+  while (timeoutCounter && !((*status = inb(kCommandPort)) & kOutputReady))
+  {
+    timeoutCounter--;
+    IODelay(kDataDelay);
+  }
+  if (timeoutCounter == 0)
+    return false;
+
+  //
+  // For older machines, it is necessary to wait a while after the controller
+  // has asserted the output buffer bit before reading the data port. No more
+  // data will be available if this wait is not performed.
+  //
+
+  IODelay(kDataDelay);
+  *readByte = inb(kDataPort);
+  return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2Controller::completePendingRead()
+{
+  //
+  // Called at primary interrupt time while interrupts are being ignored.  If
+  // a request is asleep in waitForDataPort, read the byte for it and wake it
+  // up; otherwise leave the data for the request to poll, as before.
+  //
+
+  if (!OSCompareAndSwap(kReadWaiting, kReadBusy, &_readState))
+    return;
+
+  IODelay(kDataDelay);
+  UInt8 status = inb(kCommandPort);
+  if (!(status & kOutputReady))
+  {
+    OSCompareAndSwap(kReadBusy, kReadWaiting, &_readState);
+    return;
+  }
+  IODelay(kDataDelay);
+  _readByte   = inb(kDataPort);
+  _readStatus = status;
+  OSCompareAndSwap(kReadBusy, kReadDone, &_readState);
+  _cmdGate->commandWakeup((void*)&_readState, true);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2Controller::enterRequest()
+{
+  //
+  // A request sleeping in waitForDataPort releases the command gate, so
+  // another thread could start its own command sequence in the middle of
+  // it.  Wait until the port is free.  Returns false if this thread already
+  // owns it (a driver submitting a request from within its interrupt or
+  // packet handler), or if there is nothing to serialize against: the gate
+  // is gone (stop() drains the queue after releasing it) or we are not
+  // inside it, so nobody can be asleep in it.  An offline port still takes
+  // ownership, so setPowerStateGated holds the port across the wake while
+  // _hardwareOffline is set.
+  //
+
+  if (!_cmdGate || !_workLoop || !_workLoop->inGate())
+    return false;
+  IOThread self = IOThreadSelf();
+  if (_requestThread == self)
+    return false;
+  while (_requestThread)
+    _cmdGate->commandSleep(&_requestThread, THREAD_UNINT);
+  _requestThread = self;
+  return true;
+}
+
+void ApplePS2Controller::leaveRequest(bool owner)
+{
+  if (!owner || !_cmdGate)
+    return;
+  _requestThread = 0;
+  _cmdGate->commandWakeup(&_requestThread, false);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2Controller::writeDataPort(UInt8 byte)
 {
   //
@@ -1790,6 +1950,14 @@ IOReturn ApplePS2Controller::setPowerStateAction( OSObject * target,
 
 void ApplePS2Controller::setPowerStateGated( UInt32 powerState )
 {
+  //
+  // Hold the port for the whole transition, as processRequest does for one
+  // request: the device commands below may sleep in waitForDataPort, and
+  // another thread's request must not run between them.
+  //
+
+  bool owner = enterRequest();
+
   if ( _currentPowerState != powerState )
   {
     switch ( powerState )
@@ -1886,6 +2054,8 @@ void ApplePS2Controller::setPowerStateGated( UInt32 powerState )
     _currentPowerState = powerState;
   }
 
+  leaveRequest(owner);
+
   //
   // Acknowledge the power change before the power management timeout
   // expires.
@@ -126,6 +126,7 @@ class ApplePS2MouseDevice;
 // Port timings.
 
 #define kDataDelay              7       // usec to delay before data is valid
+#define kReadSliceMS            1       // sleep slice for InterruptDrivenReads
 
 // Ports used to control the PS/2 keyboard/mouse and read data from it.
 
@@ -248,6 +249,12 @@ private:
 #endif
   int                      _wakedelay;
   IOCommandGate*           _cmdGate;
+  bool                     _interruptReads;       // see waitForDataPort
+  UInt8                    _commandByteIRQs;      // kCB_Enable*IRQ bits last written
+  volatile UInt32          _readState;            // kRead*, shared with interrupt handlers
+  UInt8                    _readStatus;
+  UInt8                    _readByte;
+  IOThread                 _requestThread;        // see enterRequest
 #if WATCHDOG_TIMER
   IOTimerEventSource*      _watchdogTimer;
 #endif
@@ -268,6 +275,10 @@ private:
   virtual void  processRequestQueue(IOInterruptEventSource *, int);
 
   virtual UInt8 readDataPort(PS2DeviceType deviceType);
+  bool waitForDataPort(PS2DeviceType deviceType, UInt32& timeoutCounter, UInt8* status, UInt8* readByte);
+  void completePendingRead();
+  bool enterRequest();
+  void leaveRequest(bool owner);
   virtual void  writeCommandPort(UInt8 byte);
   virtual void  writeDataPort(UInt8 byte);
   void resetController(void);
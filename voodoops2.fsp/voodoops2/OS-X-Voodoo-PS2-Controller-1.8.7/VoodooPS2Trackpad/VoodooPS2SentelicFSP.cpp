@@ -35,221 +35,50 @@ enum {
 
 
 
-
-/* Finger-sensing Pad information registers */
-#define	FSP_REG_DEVICE_ID	0x00
-#define	FSP_REG_VERSION		0x01
-#define	FSP_REG_REVISION	0x04
-#define	FSP_REG_TMOD_STATUS1	0x0B
-#define	FSP_BIT_NO_ROTATION	0x08
-#define	FSP_REG_PAGE_CTRL	0x0F
-
-/* Finger-sensing Pad control registers */
-#define	FSP_REG_SYSCTL1		0x10
-#define	FSP_BIT_EN_REG_CLK	0x20
-#define	FSP_REG_OPC_QDOWN	0x31
-#define	FSP_BIT_EN_OPC_TAG	0x80
-#define	FSP_REG_OPTZ_XLO	0x34
-#define	FSP_REG_OPTZ_XHI	0x35
-#define	FSP_REG_OPTZ_YLO	0x36
-#define	FSP_REG_OPTZ_YHI	0x37
-#define	FSP_REG_SYSCTL5		0x40
-#define	FSP_REG_SWREG1		0x90
-
-
-#define	FSP_BIT_90_DEGREE	0x01
-#define	FSP_BIT_EN_MSID6	0x02
-#define	FSP_BIT_EN_MSID7	0x04
-#define	FSP_BIT_EN_MSID8	0x08
-#define	FSP_BIT_EN_AUTO_MSID8	0x20
-#define	FSP_BIT_EN_PKT_G0	0x40
-
-#define	FSP_REG_ONPAD_CTL	0x43
-#define	FSP_BIT_ONPAD_ENABLE	0x01
-#define	FSP_BIT_ONPAD_FBBB	0x02
-#define	FSP_BIT_FIX_VSCR	0x03
-#define	FSP_BIT_FIX_HSCR	0x20
-#define	FSP_BIT_DRAG_LOCK	0x40
-
-
-/* Finger-sensing Pad packet formating related definitions */
-
-/* absolute packet type */
-#define	FSP_PKT_TYPE_NORMAL	(0x00)
-#define	FSP_PKT_TYPE_ABS	(0x01)
-#define	FSP_PKT_TYPE_NOTIFY	(0x02)
-#define	FSP_PKT_TYPE_NORMAL_OPC	(0x03)
-#define	FSP_PKT_TYPE_SHIFT	(6)
-
-
-#define FSP_DEVICE_MAGIC		0x01
-
-
-/* swreg1 values, supported in Cx hardware */
-#define FSP_CX_ABSOLUTE_MODE     0x01
-#define FSP_CX_GESTURE_OUTPUT	0x02
-#define FSP_CX_2FINGERS_OUTPUT	0x04
-#define FSP_CX_FINGER_UP_OUTPUT	0x08
-#define FSP_CX_CONTINUOUS_MODE	0x10
-#define FSP_CX_GUEST_GROUP_BIT1  0x20
-#define FSP_CX_GUEST_GROUP_BIT2  0x40
-#define FSP_CX_COMPATIBLE_MODE   0x80
-
-#define FSP_CX_NOTIFY_MSG_TYPE_GUESTURE         0xba
-#define FSP_CX_NOTIFY_MSG_TYPE_ONE_FINGER_HOLD  0xC0
-
-//byte0
-#define MFMT_LEFT_BTN_DOWN  0x01
-#define MFMT_RIGHT_BTN_DOWN 0x02
-#define MFMT_FINGER_INDEX   0x04
-#define MFMT_PS2_SPECIFY    0x08
-#define MFMT_LEFT_BTN_OPC   0x10
-#define MFMT_COORD_MODE     0x20
-
-//byte3
-#define MFMT_SCROLL_RIGHT_BTN 0x80
-#define MFMT_SCROLL_LEFT_BTN  0x40
-#define MFMT_5TH_BTN          0x20
-#define MFMT_4TH_BTN          0x10
-
-#define MFMT_MID_BTN_DOWN   0x04
-
-
-
-
-
 // =============================================================================
 // ApplePS2SentelicFSP Class Implementation
 //
 
 OSDefineMetaClassAndStructors(ApplePS2SentelicFSP, IOHIPointing);
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Keyboard messages for the gesture table's FSPGestureMessage args.
+//
 
-
-
-const char * fsp_get_guesture_name_by_id(int gestureId)
+static const int fsp_gesture_message[kFSPMessageCount] =
 {
-    /*
-     ID	Description
-     0x86	2 finger straight up
-     0x82	2 finger straight down
-     0x80	2 finger straight right
-     0x84	2 finger straight left
-     0x8f	2 finger zoom in
-     0x8b	2 finger zoom out
-     0xc0	2 finger curve, counter clockwise
-     0xc4	2 finger curve, clockwise
-     0x2e	3 finger straight up
-     0x2a	3 finger straight down
-     0x28	3 finger straight right
-     0x2c	3 finger straight left
-     0x38	palm
-     */
-    
-    switch (gestureId) {
-        case	0x86:	return ("	2 finger straight up             ");break;
-        case	0x82:	return ("	2 finger straight down           ");break;
-        case	0x80:	return ("	2 finger straight right          ");break;
-        case	0x84:	return ("	2 finger straight left           ");break;
-        case	0x8f:	return ("	2 finger zoom in                 ");break;
-        case	0x8b:	return ("	2 finger zoom out                ");break;
-        case	0xc0:	return ("	2 finger curve, counter clockwise");break;
-        case	0xc4:	return ("	2 finger curve, clockwise        ");break;
-        case	0x2e:	return ("	3 finger straight up             ");break;
-        case	0x2a:	return ("	3 finger straight down           ");break;
-        case	0x28:	return ("	3 finger straight right          ");break;
-        case	0x2c:	return ("	3 finger straight left           ");break;
-        case	0x38:	return ("	palm                             ");break;
-        default:
-            return         ("unkonw Guesture id               ");
-            break;
-    }
-    
-    
-}
+    kPS2M_swipeDown,
+    kPS2M_swipeUp,
+    kPS2M_swipeLeft,
+    kPS2M_swipeRight,
+    kPS2M_zoomIn,
+    kPS2M_zoomOut,
+    kPS2M_rotateL,
+    kPS2M_rotateR,
+    kPS2M_lauchPad
+};
 
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Snaps a SampleRate to the nearest rate the PS/2 mouse protocol defines.
+// The FSP also treats some other values after F3 as commands (0x66 and 0x88
+// are register access knock bytes), so only these go out.  0 stays 0.
+//
 
-void fsp_packet_debug(unsigned char packet[],UInt32 packetSize)
+static int fsp_legal_sample_rate(int rate)
 {
-	static unsigned int ps2_packet_cnt;
-	//static unsigned int ps2_last_second;
-//	unsigned int jiffies_msec;
-	const char *packet_type = "UNKNOWN";
-	int abs_x = 0, abs_y = 0;
-    int lb=0,rb=0,mb=0,fi=0,opc=0,cm=0;
-    int sl=0,sr=0,b4=0,b5=0;
-	/* Interpret & dump the packet data. */
-	switch (packet[0] >> FSP_PKT_TYPE_SHIFT) {
-        case FSP_PKT_TYPE_ABS:
-            packet_type = "Absolute";
-            abs_x = (packet[1] << 2) | ((packet[3] >> 2) & 0x03);
-            abs_y = (packet[2] << 2) | (packet[3] & 0x03);
-          
-            if(MFMT_LEFT_BTN_DOWN & packet[0]) lb=1;
-            if(MFMT_RIGHT_BTN_DOWN &packet[0]) rb =1;
-            if(MFMT_FINGER_INDEX&packet[0]) fi=1;
-            if(MFMT_LEFT_BTN_OPC&packet[0]) opc=1;
-            if(MFMT_COORD_MODE&packet[0]) cm=1;
-            
-            if(MFMT_4TH_BTN&packet[3])b4=1;
-            if(MFMT_5TH_BTN&packet[3])b5=1;
-            if(MFMT_SCROLL_LEFT_BTN&packet[3])sl=1;
-            if(MFMT_SCROLL_RIGHT_BTN&packet[3]) sr =1;
-            
-            IOLog(
-                  "%08d: %s packet: %02x, %02x, %02x, %02x;"
-                  "abs_x: %d, abs_y: %d,"
-                  "lb:%d,rb:%d,fi:%d,opc:%d,cm:%d,b4:%d,b5:%d,sl:%d,sr:%d\n",
-                  ps2_packet_cnt, packet_type,
-                  packet[0], packet[1], packet[2], packet[3],
-                  abs_x, abs_y,
-                  lb,rb,fi,opc,cm,
-                  b4,b5,sl,sr
-                  );
-            
-            break;
-        case FSP_PKT_TYPE_NORMAL:
-            packet_type = "Normal";
-            IOLog(
-                  "%08d: %s packet: %02x, %02x, %02x, %02x;",
-                  ps2_packet_cnt, packet_type,
-                  packet[0], packet[1], packet[2], packet[3]);
-            
-            break;
-        case FSP_PKT_TYPE_NOTIFY:
-            if(MFMT_LEFT_BTN_DOWN & packet[0]) lb=1;
-            if(MFMT_RIGHT_BTN_DOWN &packet[0]) rb =1;
-            if(MFMT_MID_BTN_DOWN&packet[0]) mb=1;
-            if(MFMT_LEFT_BTN_OPC&packet[0]) opc=1;
-            
-            packet_type = "Notify";
-            
-            IOLog(
-                  "%08d: %s: %02x, %02x, %02x, %02x;"
-                  "lb:%d,rb:%d,mb:%d,opc:%d\n",
-                  ps2_packet_cnt, packet[1]==0xba?fsp_get_guesture_name_by_id(packet[2]):packet_type,
-                  packet[0], packet[1], packet[2], packet[3],
-                  lb, rb,mb,opc);
-            
-            break;
-        case FSP_PKT_TYPE_NORMAL_OPC:
-            packet_type = "Normal-OPC";
-            IOLog(
-                  "%08d: %s packet: %02x, %02x, %02x, %02x;",
-                  ps2_packet_cnt, packet_type,
-                  packet[0], packet[1], packet[2], packet[3]);
-            
-            break;
-	}
+    static const int rates[] = { 10, 20, 40, 60, 80, 100, 200 };
     
-	ps2_packet_cnt++;
-	//jiffies_msec = jiffies_to_msecs(jiffies);
-
-//	if (jiffies_msec - ps2_last_second > 1000) {
-//		psmouse_dbg(psmouse, "PS/2 packets/sec = %d\n", ps2_packet_cnt);
-//		ps2_packet_cnt = 0;
-//		ps2_last_second = jiffies_msec;
-//	}
+    if (rate <= 0)
+        return 0;
+    int best = rates[0];
+    for (int i = 1; i < countof(rates); i++)
+    {
+        int d = rates[i] - rate;
+        int b = best - rate;
+        if ((d < 0 ? -d : d) < (b < 0 ? -b : b))
+            best = rates[i];
+    }
+    return best;
 }
 
 
@@ -274,6 +103,17 @@ bool ApplePS2SentelicFSP::init(OSDictionary* dict)
     if (!super::init(dict))
         return false;
 	
+    wakedelay = 1000;
+    scrollHistoryDepth = 8;
+    momentumscrollmultiplier = kFSPFlingMultiplier;
+    momentumscrolldivisor = kFSPFlingDivisor;
+    momentumscrollthreshold = 0;
+    samplerate = 80;
+    accelnum = 1;
+    acceldenom = 1;
+    accelthreshold = 4;
+    zoomrotatethreshold = 0;
+    
     // find config specific to Platform Profile
     OSDictionary* list = OSDynamicCast(OSDictionary, dict->getObject(kPlatformProfile));
     OSDictionary* config = ApplePS2Controller::makeConfigurationNode(list);
@@ -286,34 +126,105 @@ bool ApplePS2SentelicFSP::init(OSDictionary* dict)
             config->release();
             return false;
         }
+        OSNumber* delay = OSDynamicCast(OSNumber, config->getObject("WakeDelay"));
+        if (delay)
+            wakedelay = delay->unsigned32BitValue();
+        OSNumber* depth = OSDynamicCast(OSNumber, config->getObject("ScrollHistoryDepth"));
+        if (depth)
+            scrollHistoryDepth = depth->unsigned32BitValue();
+        OSNumber* num;
+        if ((num = OSDynamicCast(OSNumber, config->getObject("MomentumScrollMultiplier"))))
+            momentumscrollmultiplier = num->unsigned32BitValue();
+        if ((num = OSDynamicCast(OSNumber, config->getObject("MomentumScrollDivisor"))))
+            momentumscrolldivisor = num->unsigned32BitValue();
+        if ((num = OSDynamicCast(OSNumber, config->getObject("MomentumScrollThreshold"))))
+            momentumscrollthreshold = num->unsigned32BitValue();
+        if ((num = OSDynamicCast(OSNumber, config->getObject("SampleRate"))))
+        {
+            samplerate = fsp_legal_sample_rate(num->unsigned32BitValue());
+            if (samplerate != (int)num->unsigned32BitValue())
+                IOLog("ApplePS2Trackpad: Sentelic FSP: SampleRate %u not supported, using %d\n",
+                      num->unsigned32BitValue(), samplerate);
+        }
+        if ((num = OSDynamicCast(OSNumber, config->getObject("AccelNumerator"))))
+            accelnum = num->unsigned32BitValue();
+        if ((num = OSDynamicCast(OSNumber, config->getObject("AccelDenominator"))))
+            acceldenom = num->unsigned32BitValue();
+        if ((num = OSDynamicCast(OSNumber, config->getObject("AccelThreshold"))))
+            accelthreshold = num->unsigned32BitValue();
+        if ((num = OSDynamicCast(OSNumber, config->getObject("ZoomRotateThreshold"))))
+            zoomrotatethreshold = num->unsigned32BitValue();
+        OSBoolean* trace = OSDynamicCast(OSBoolean, config->getObject("PacketTrace"));
+        _trace.enabled = trace && trace->isTrue();
 #ifdef DEBUG
         // save configuration for later/diagnostics...
         setProperty(kMergedConfiguration, config);
 #endif
     }
     
+    fsp_gesture_table_init();
+    
+    _packetTimes.reset();
+    fsp_assembler_reset(&_assembler);
+    _assembler.resyncs = 0;
+    _batchTime = 0;
+    _packetTime = 0;
+    _rateWindowStart = 0;
+    _rateCount = 0;
+    _measuredRate = 0;
+    _packetsReceived = 0;
+    _pointerEvents = 0;
+    _palmDown = false;
+    _palmSuppressed = 0;
+    _dispatchType = kFSPTraceDropped;
+    _gestureMessage = -1;
+    _gestureAccum = 0;
+    _gestureMessageSent = false;
+    _gestureMessagesSuppressed = 0;
+    memset(_gestureStats, 0, sizeof(_gestureStats));
+    _gestureActive = false;
+    _gestureId = 0;
+    _gestureStart = 0;
+    _gestureStatsDirty = false;
+    _pendingMotion = false;
+    _pendingDx = _pendingDy = 0;
+    _pendingButtons = 0;
+    _pendingTime = 0;
+    _latency.reset();
+    _latencyPublishTime = 0;
+    nanoseconds_to_absolutetime(1000000000ULL, &_latencyPublishInterval);
+    
     // initialize state
     _device                    = 0;
     _interruptHandlerInstalled = false;
-    _packetByteCount           = 0;
     _resolution                = (250) << 16; // (100 dpi, 4 counts/mm)
     _scrollresolution             = (250) <<16;
     _touchPadModeByte          =  kModeByteValueGesturesEnabled;//kModeByteValueGesturesDisabled;
     
-    _last_abs_x = 0;
-    _last_abs_y = 0;
     _last_abs_z  = 0;
+    fsp_abs_reset(&_abs);
     
     _isInGesture = false;
+    fsp_tracker_reset(&_fingers);
     
     keytime =0;
     _modifierdown=0;
     gestureStopTime=0;
     
-     maxaftertyping = 500000000;
-    scrolllockTime =    500000000;
-    
-    momentumscrollInteval = 20000000;
+    // all time thresholds are kept in absolute time units, so the packet
+    // path can compare them against clock_get_uptime directly
+    nanoseconds_to_absolutetime(500000000, &maxaftertyping);
+    nanoseconds_to_absolutetime(500000000, &scrolllockTime);
+    
+    nanoseconds_to_absolutetime(20000000, &momentumscrollInteval);
+    _flingTicks = 1;
+    _flingTimerFires = 0;
+    z_avg.setFlingInterval(momentumscrollInteval);
+    z_avg.setHistoryDepth(scrollHistoryDepth);
+    if (!z_avg.setFlingDecay(momentumscrollmultiplier, momentumscrolldivisor, momentumscrollthreshold))
+        IOLog("ApplePS2Trackpad: Sentelic FSP: momentum scroll decay %d/%d ignored, using %d/%d\n",
+              momentumscrollmultiplier, momentumscrolldivisor, kFSPFlingMultiplier, kFSPFlingDivisor);
+    buildAccelTable();
     OSSafeRelease(config);
 	
     return true;
@@ -321,380 +232,6 @@ bool ApplePS2SentelicFSP::init(OSDictionary* dict)
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
-
-int fsp_ps2_command(ApplePS2MouseDevice * device, PS2Request * request, int cmd)
-{
-    request->commands[0].command  = kPS2C_WriteCommandPort;
-    request->commands[0].inOrOut  = kCP_TransmitToMouse;
-    request->commands[1].command  = kPS2C_WriteDataPort;
-    request->commands[1].inOrOut  = cmd;
-    request->commands[2].command  = kPS2C_ReadDataPort;
-    request->commands[2].inOrOut  = 0;
-
-    request->commandsCount = 3;
-    device->submitRequestAndBlock(request);
-
-    //IOLog("ApplePS2Trackpad: Sentelic FSP: fsp_ps2_command(cmd = %0x) => %0x\n", cmd, request->commands[2].inOrOut);
-
-    return (request->commandsCount == 3) ? request->commands[2].inOrOut : -1;
-}
-
-int fsp_reg_read(ApplePS2MouseDevice * device, PS2Request * request, int reg)
-{
-    int register_select = 0x66;
-    int register_value = reg;
-
-    // mangle reg to avoid collision with reserved values
-    if (reg == 10 || reg == 20 || reg == 40 || reg == 60 || reg == 80 || reg == 100 || reg == 200) {
-        register_value = (reg >> 4) | (reg << 4);
-        register_select = 0xCC;
-    } else if (reg == 0xe9 || reg == 0xee || reg == 0xf2 || reg == 0xff) {
-        register_value = ~reg;
-        register_select = 0x68;
-    }
-
-    fsp_ps2_command(device, request, 0xf3);
-    fsp_ps2_command(device, request, 0x66);
-    fsp_ps2_command(device, request, 0x88);
-    fsp_ps2_command(device, request, 0xf3);
-    fsp_ps2_command(device, request, register_select);
-    fsp_ps2_command(device, request, register_value);
-
-    request->commands[0].command  = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[0].inOrOut  = kDP_GetMouseInformation;
-    request->commands[1].command  = kPS2C_ReadDataPort;
-    request->commands[1].inOrOut  = 0;
-    request->commands[2].command  = kPS2C_ReadDataPort;
-    request->commands[2].inOrOut  = 0;
-    request->commands[3].command  = kPS2C_ReadDataPort;
-    request->commands[3].inOrOut  = 0;
-
-    request->commandsCount = 4;
-    device->submitRequestAndBlock(request);
-
-  //  IOLog("ApplePS2Trackpad: Sentelic FSP: fsp_reg_read(reg = %0x) => %0x\n", reg, request->commands[3].inOrOut);
-
-    return (request->commandsCount == 4) ? request->commands[3].inOrOut : -1;
-}
-
-void fsp_reg_write(ApplePS2MouseDevice * device, PS2Request * request, int reg, int val)
-{
-    int register_select = 0x55;
-    int register_value = reg;
-
-    // mangle reg to avoid collision with reserved values
-    if (reg == 10 || reg == 20 || reg == 40 || reg == 60 || reg == 80 || reg == 100 || reg == 200) {
-        register_value = (reg >> 4) | (reg << 4);
-        register_select = 0x77;
-    } else if (reg == 0xe9 || reg == 0xee || reg == 0xf2 || reg == 0xff) {
-        register_value = ~reg;
-        register_select = 0x74;
-    }
-
-    fsp_ps2_command(device, request, 0xf3);
-    fsp_ps2_command(device, request, register_select);
-    fsp_ps2_command(device, request, register_value);
-
-    register_select = 0x33;
-    register_value = val;
-
-    // mangle val to avoid collision with reserved values
-    if (val == 10 || val == 20 || val == 40 || val == 60 || val == 80 || val == 100 || val == 200) {
-        register_value = (val >> 4) | (val << 4);
-        register_select = 0x44;
-    } else if (val == 0xe9 || val == 0xee || val == 0xf2 || val == 0xff) {
-        register_value = ~val;
-        register_select = 0x47;
-    }
-
-    fsp_ps2_command(device, request, 0xf3);
-    fsp_ps2_command(device, request, register_select);
-    fsp_ps2_command(device, request, register_value);
-
-//    IOLog("ApplePS2Trackpad: Sentelic FSP: fsp_reg_write(reg = %0x, val = %0x)\n", reg, val);
-}
-
-void fsp_write_enable(ApplePS2MouseDevice * device, PS2Request * request, int enable)
-{
-    int wen = fsp_reg_read(device, request, FSP_REG_SYSCTL1);
-
-    if (enable)
-        wen |= FSP_BIT_EN_REG_CLK; 
-    else
-        wen &= ~FSP_BIT_EN_REG_CLK;
-
-    fsp_reg_write(device, request, FSP_REG_SYSCTL1, wen);
-}
-
-void fsp_opctag_enable(ApplePS2MouseDevice * device, PS2Request * request, int enable)
-{
-    fsp_write_enable(device, request, true);
-
-    int opc = fsp_reg_read(device, request, FSP_REG_OPC_QDOWN);
-
-    if (enable)
-        opc |= FSP_BIT_EN_OPC_TAG; 
-    else
-        opc &= ~FSP_BIT_EN_OPC_TAG;
-
-    fsp_reg_write(device, request, FSP_REG_OPC_QDOWN, opc);
-
-    fsp_write_enable(device, request, false);
-}
-
-/*
- 测试一下读取REG
- */
-int fsp_get_buttons(ApplePS2MouseDevice * device,PS2Request * request)
-{
-	static const int buttons[] = {
-		0x16, /* Left/Middle/Right/Forward/Backward & Scroll Up/Down */
-		0x06, /* Left/Middle/Right & Scroll Up/Down/Right/Left */
-		0x04, /* Left/Middle/Right & Scroll Up/Down */
-		0x02, /* Left/Middle/Right */
-	};
-	int val=fsp_reg_read(device, request,FSP_REG_TMOD_STATUS1) ;
-    
-	if (val== -1)
-		return -1;
-    
-	return buttons[(val & 0x30) >> 4];
-}
-/*
- 打开vscr?
- */
- int fsp_onpad_vscr(ApplePS2MouseDevice * device, PS2Request * request ,int enable)
-{
-  //  TPS2Request<> req;
-//    PS2Request * request = &req;
-    int val = fsp_reg_read(device,request,FSP_REG_ONPAD_CTL);
-	
-    
-	
-	if (enable)
-		val |= (FSP_BIT_FIX_VSCR | FSP_BIT_ONPAD_ENABLE);
-	else
-		val &= (0xff ^ FSP_BIT_FIX_VSCR);
-    
-	fsp_reg_write(device, request,FSP_REG_ONPAD_CTL, val);
-	
-	return 0;
-}
-
-
-int fsp_onpad_hscr(ApplePS2MouseDevice *psmouse,PS2Request * request , bool enable)
-{
-    //TPS2Request<> req;
-	//struct fsp_data *pad = psmouse->private;
-	int val, v2;
-    
-	val=fsp_reg_read(psmouse, request, FSP_REG_ONPAD_CTL);
-    if(val==-1)
-		return -1;
-    
-	v2 = fsp_reg_read(psmouse,request,FSP_REG_SYSCTL5);
-	if(v2)
-        return -1;
-    
-//	pad->hscroll = enable;
-    
-	if (enable) {
-		val |= (FSP_BIT_FIX_HSCR | FSP_BIT_ONPAD_ENABLE);
-		v2 |= FSP_BIT_EN_MSID6;
-	} else {
-		val &= ~FSP_BIT_FIX_HSCR;
-		v2 &= ~(FSP_BIT_EN_MSID6 | FSP_BIT_EN_MSID7 | FSP_BIT_EN_MSID8);
-	}
-    
-	fsp_reg_write(psmouse, request,FSP_REG_ONPAD_CTL, val);
-	
-    
-	/* reconfigure horizontal scrolling packet output */
-     fsp_reg_write(psmouse,request, FSP_REG_SYSCTL5, v2);
-	
-    
-	return 0;
-}
-
-int fsp_onpad_icon(ApplePS2MouseDevice * psmouse,PS2Request * request,int enable)
-{
-	int val;
-  
-    /* enable icon switch button and absolute packet */
-	val = fsp_reg_read(psmouse, request,FSP_REG_SYSCTL5);
-    
-	val &= ~(FSP_BIT_EN_MSID7 | FSP_BIT_EN_MSID8 | FSP_BIT_EN_AUTO_MSID8);
-    
-	if (enable) {
-		val |= (FSP_BIT_EN_MSID8 | FSP_BIT_EN_PKT_G0);
-		
-    }
-    
-    
-    
-    
-	fsp_reg_write(psmouse,request,FSP_REG_SYSCTL5, val);
-	return 0;
-}
-
-
-int fsp_intellimouse_mode(ApplePS2MouseDevice * device, PS2Request * request)
-{
-    request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[0].inOrOut = kDP_SetMouseSampleRate;
-    request->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[1].inOrOut = 200;
-
-    request->commands[2].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[2].inOrOut = kDP_SetMouseSampleRate;
-    request->commands[3].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[3].inOrOut = 200;
-
-    request->commands[4].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[4].inOrOut = kDP_SetMouseSampleRate;
-    request->commands[5].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[5].inOrOut = 80;
-
-    request->commands[6].command = kPS2C_SendMouseCommandAndCompareAck;
-    request->commands[6].inOrOut = kDP_GetId;
-    request->commands[7].command = kPS2C_ReadDataPort;
-    request->commands[7].inOrOut = 0;
-
-    request->commandsCount = 8;
-    device->submitRequestAndBlock(request);
-
-    IOLog("ApplePS2Trackpad: Sentelic FSP: fsp_intellimouse_mode() => %0x\n", request->commands[7].inOrOut);
-
-    return request->commands[7].inOrOut;
-}
-
-
-
-
-ScrollSmoother::ScrollSmoother(){
-    
-}
-
-ScrollSmoother::~ScrollSmoother(){
-    
-}
-
-double ScrollSmoother::getSpeed(){
-    return 0.0;
-}
-
-int ScrollSmoother::getDelta(){
-    
-    return 0;
-}
-
-int ScrollSmoother::getDir()
-{
-    return this->direction;
-}
-
-
-int  ScrollSmoother::filter(int z)
-{
-    
-    if(z>0&& stopDelta>0)
-    {
-        stopDelta = 0;
-    }
-
-    if(cur_history_index>= sizeof(history)/sizeof(int))
-    {
-        cur_history_index=0;
-    }
-    history[cur_history_index++] = z;
-    
-    clock_get_uptime(&lastinputTime);
-    
-    inputCount ++;
-    
-    
-    
-    if(inputCount%2==1)
-    {
-        if(inputCount>2)
-        {
-            
-            return lastDelta * SCROLL_DELTA_FACTOR;
-        }
-        else
-        {
-            return 0;
-        }
-    }
-    else
-    {
-        int dz = (history[1] + history[0])/2;
-        
-        if(lastDelta > dz)
-            deltaDir = SCROLL_DELTA_DESCREASE;
-        else if(lastDelta<dz)
-            deltaDir = SCROLL_DELTA_INSCREASE;
-        else
-            deltaDir = SCROLL_DELTA_EVEN;
-        
-        if(dz>maxDelta)
-        {
-            maxDelta  =z;
-        }
-        
-        return dz* SCROLL_DELTA_FACTOR;
-    }
-    
-    
-    
-    return 0;
-}
-
-int  ScrollSmoother::stop(){
-    if(lastinputTime!=0)
-    {
-     //   IOLog("stop delta = %d\n",lastDelta);
-        if(inputCount<10)
-        {
-            stopDelta = maxDelta*SCROLL_DELTA_FACTOR;
-        }
-        
-        decDelta =1;
-        lastDelta = 0;
-        cur_history_index = 0 ;
-        lastinputTime = 0;
-        lastspeedCalcTime = 0;
-        inputCount = 0;
-        maxDelta = 0;
-        memset(history, 0, sizeof(history));
-        return stopDelta;
-    }
-    else
-    {
-        return 0;
-    }
-    
-}
-
-void ScrollSmoother::setDir(int dir)
-{
-    this->direction  = dir;
-}
-
-
-int  ScrollSmoother::getFlingDelta()
-{
-    if(stopDelta>0)
-    {
-        stopDelta = stopDelta*0.6;
-        return stopDelta;
-      
-    }
-    return 0;
-}
-
-// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-
 ApplePS2SentelicFSP* ApplePS2SentelicFSP::probe( IOService * provider, SInt32 * score )
 {
     DEBUG_LOG("ApplePS2SentelicFSP::probe entered...\n");
@@ -713,14 +250,15 @@ ApplePS2SentelicFSP* ApplePS2SentelicFSP::probe( IOService * provider, SInt32 *
         return 0;
         
     bool success = false;
-    TPS2Request<> request;
-    if (fsp_reg_read(device, &request, FSP_REG_DEVICE_ID) == FSP_DEVICE_MAGIC)
+    uint64_t start_abs, end_abs;
+    clock_get_uptime(&start_abs);
+    
+    if (fsp_identify(device, &_touchPadVersion, &_buttons))
     {
-        _touchPadVersion =
-		(fsp_reg_read(device, &request, FSP_REG_VERSION) << 8) |
-		(fsp_reg_read(device, &request, FSP_REG_REVISION));
-		
-        _buttons = fsp_get_buttons(device,&request);
+        clock_get_uptime(&end_abs);
+        uint64_t ns;
+        absolutetime_to_nanoseconds(end_abs - start_abs, &ns);
+        setProperty("ProbeTime", ns / 1000, 32);
         
         success = true;
     }
@@ -730,9 +268,28 @@ ApplePS2SentelicFSP* ApplePS2SentelicFSP::probe( IOService * provider, SInt32 *
 }
 
 
+void ApplePS2SentelicFSP::startMomentumScroll()
+{
+    _flingTicks = 1;
+    _flingTimerFires = 0;
+    setTimerTimeout(scrollTimer,momentumscrollInteval);
+}
+
 void ApplePS2SentelicFSP::onScrollTimer(void)
 {
-    int dz = z_avg.getFlingDelta();
+    //
+    // Each fire folds _flingTicks decay steps into one scroll event, so the
+    // distance scrolled is the same but a slow fling wakes up less often.
+    //
+    int dz = 0;
+    for (int i = 0; i < _flingTicks; i++)
+    {
+        int step = z_avg.getFlingDelta();
+        if (step <= 0)
+            break;
+        dz += step;
+    }
+    ++_flingTimerFires;
     if(dz>0)
     {
         
@@ -772,10 +329,16 @@ void ApplePS2SentelicFSP::onScrollTimer(void)
                 break;
         }
         
-        setTimerTimeout(scrollTimer,momentumscrollInteval);
-       
+        if (z_avg.isFlinging())
+        {
+            if (dz < kFSPFlingStretchDelta*_flingTicks && _flingTicks < kFSPFlingMaxTicks)
+                _flingTicks *= 2;
+            setTimerTimeout(scrollTimer,momentumscrollInteval*_flingTicks);
+            return;
+        }
     }
     
+    setProperty("MomentumScrollTimerFires", _flingTimerFires, 32);
 }
 
 
@@ -967,37 +530,274 @@ PS2InterruptResult ApplePS2SentelicFSP::interruptOccurred( UInt8 data )
     //
     // Ignore all bytes until we see the start of a packet, otherwise the
     // packets may get out of sequence and things will get very confusing.
-    //
-    if (_packetByteCount == 0 && ((data == kSC_Acknowledge) || !(data & 0x08)))
-    {
-        DEBUG_LOG("%s: Unexpected byte0 data (%02x) from PS/2 controller\n", getName(), data);
-        return kPS2IR_packetBuffering;
-    }
-	
+    // fsp_assemble_byte does that, and resyncs on packets that cannot be
+    // real; each ring buffer slot (kPacketLengthMax) holds FSP_PACKET_MAX.
     //
     // Add this byte to the packet buffer. If the packet is complete, that is,
-    // we have the three bytes, dispatch this packet for processing.
+    // we have the _packetSize bytes, dispatch this packet for processing.
     //
 	
-    UInt8* packet = _ringBuffer.head();
-    packet[_packetByteCount++] = data;
-    if (_packetByteCount == _packetSize)
+    uint64_t time;
+    clock_get_uptime(&time);
+    switch (fsp_assemble_byte(&_assembler, _ringBuffer.head(), _packetSize, data, time))
+    {
+        case kFSPAssembleDropped:
+            DEBUG_LOG("%s: Unexpected byte0 data (%02x) from PS/2 controller\n", getName(), data);
+            return kPS2IR_packetBuffering;
+        case kFSPAssembleReady:
+            break;
+        default:
+            return kPS2IR_packetBuffering;
+    }
+    
+    // both rings hold 31 entries, so they fill and drain in step
+    _packetTimes.push(_assembler.start);
+    _ringBuffer.advanceHead(kPacketLengthMax);
+    
+    // packets/sec over windows of about a second of continuous reports;
+    // a longer gap (finger lifted) just starts a new window
+    ++_rateCount;
+    uint64_t elapsed = _assembler.start - _rateWindowStart;
+    if (elapsed >= _latencyPublishInterval)
     {
-        _ringBuffer.advanceHead(kPacketLengthMax);
-        _packetByteCount = 0;
-        return kPS2IR_packetReady;
+        if (elapsed < 2*_latencyPublishInterval)
+        {
+            uint64_t ns;
+            absolutetime_to_nanoseconds(elapsed, &ns);
+            _measuredRate = (UInt32)(_rateCount * 1000000000ULL / ns);
+        }
+        _rateWindowStart = _assembler.start;
+        _rateCount = 0;
     }
-    return kPS2IR_packetBuffering;
+    return kPS2IR_packetReady;
 }
 
 void ApplePS2SentelicFSP::packetReady()
 {
     // empty the ring buffer, dispatching each packet...
+    uint64_t now_abs = 0;
+    uint64_t deferred[32];      // start times of packets still in the pending event
+    int ndeferred = 0;
+    
+    // one timestamp for the whole batch
+    clock_get_uptime(&_batchTime);
     while (_ringBuffer.count() >= kPacketLengthMax)
     {
+        uint64_t start = _packetTimes.count() ? _packetTimes.fetch() : 0;
+        
+        ++_packetsReceived;
+        _packetTime = start ? start : _batchTime;
         dispatchRelativePointerEventWithPacket(_ringBuffer.tail(), _packetSize);
+        if (_trace.enabled)
+            _trace.record(start, _ringBuffer.tail(), _packetSize, _dispatchType);
         _ringBuffer.advanceTail(kPacketLengthMax);
+        
+        if (start && ndeferred < countof(deferred))
+            deferred[ndeferred++] = start;
+        if (!_pendingMotion)
+            recordLatency(deferred, ndeferred, &now_abs);
+    }
+    
+    // motion merged from the packets above goes out now
+    flushRelativePointerEvent();
+    recordLatency(deferred, ndeferred, &now_abs);
+    
+    if (_batchTime - _latencyPublishTime > _latencyPublishInterval)
+    {
+        _latencyPublishTime = _batchTime;
+        publishLatencyHistogram();
+        setProperty("PacketResyncs", _assembler.resyncs, 32);
+        setProperty("PacketsReceived", _packetsReceived, 32);
+        setProperty("PointerEventsEmitted", _pointerEvents, 32);
+        setProperty("PalmPacketsSuppressed", _palmSuppressed, 32);
+        setProperty("GestureMessagesSuppressed", _gestureMessagesSuppressed, 32);
+        setProperty("MeasuredSampleRate", _measuredRate, 32);
+        if (_gestureStatsDirty)
+            publishGestureStats();
+        if (_trace.enabled)
+            publishPacketTrace();
+    }
+}
+
+void ApplePS2SentelicFSP::recordLatency(uint64_t start[], int& count, uint64_t* now_abs)
+{
+    if (!count)
+        return;
+    clock_get_uptime(now_abs);
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t ns;
+        absolutetime_to_nanoseconds(*now_abs - start[i], &ns);
+        _latency.record(ns);
     }
+    count = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Gesture statistics: a gesture runs from its first notify until gesture end,
+// finger up or a notify with a different ID.
+//
+
+void ApplePS2SentelicFSP::countGesture(UInt8 id, uint64_t now)
+{
+    if (_gestureActive && id != _gestureId)
+        endGestureStats(now);
+    if (!_gestureActive)
+    {
+        _gestureActive = true;
+        _gestureId = id;
+        _gestureStart = now;
+        ++_gestureStats[id].count;
+    }
+    ++_gestureStats[id].packets;
+}
+
+void ApplePS2SentelicFSP::endGestureStats(uint64_t now)
+{
+    if (!_gestureActive)
+        return;
+    _gestureStats[_gestureId].duration += now - _gestureStart;
+    _gestureActive = false;
+    _gestureStatsDirty = true;
+}
+
+void ApplePS2SentelicFSP::publishGestureStats()
+{
+    OSDictionary* dict = OSDictionary::withCapacity(16);
+    if (!dict)
+        return;
+    for (int id = 0; id < countof(_gestureStats); id++)
+    {
+        const FSPGestureStats& stats = _gestureStats[id];
+        if (!stats.count)
+            continue;
+        OSDictionary* entry = OSDictionary::withCapacity(3);
+        if (!entry)
+            break;
+        uint64_t ns;
+        absolutetime_to_nanoseconds(stats.duration, &ns);
+        OSNumber* num;
+        if ((num = OSNumber::withNumber(stats.count, 32)))
+        {
+            entry->setObject("Count", num);
+            num->release();
+        }
+        if ((num = OSNumber::withNumber(ns / 1000000, 64)))
+        {
+            entry->setObject("TotalDuration", num);    // ms
+            num->release();
+        }
+        if ((num = OSNumber::withNumber(stats.packets / stats.count, 32)))
+        {
+            entry->setObject("MeanPackets", num);
+            num->release();
+        }
+        char key[8];
+        snprintf(key, sizeof(key), "0x%02x", id);
+        dict->setObject(key, entry);
+        entry->release();
+    }
+    setProperty("GestureStatistics", dict);
+    dict->release();
+    _gestureStatsDirty = false;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Zoom and rotate notifies arrive on every packet of the gesture.  Each
+// keyboard message becomes a synthetic key sequence, so the gesture value
+// deltas are added up and a message goes out for every ZoomRotateThreshold
+// of movement.  A gesture that ends below the threshold still sends one.
+// With ZoomRotateThreshold 0 the message is sent once per gesture.
+//
+
+void ApplePS2SentelicFSP::accumulateGestureMessage(int message, int dz, uint64_t now)
+{
+    if (message != _gestureMessage)
+    {
+        // zoom in turned into zoom out (or similar), finish the old one
+        flushGestureMessage(now);
+        _gestureMessage = message;
+        _gestureAccum = 0;
+        _gestureMessageSent = false;
+    }
+    _gestureAccum += dz < 0 ? -dz : dz;
+    
+    bool send;
+    if (zoomrotatethreshold <= 0)
+        send = !_gestureMessageSent;
+    else if ((send = _gestureAccum >= zoomrotatethreshold))
+        _gestureAccum %= zoomrotatethreshold;
+    
+    if (send)
+    {
+        _gestureMessageSent = true;
+        _device->dispatchKeyboardMessage(message, &now);
+    }
+    else
+        ++_gestureMessagesSuppressed;
+}
+
+void ApplePS2SentelicFSP::flushGestureMessage(uint64_t now)
+{
+    if (_gestureMessage >= 0 && !_gestureMessageSent)
+        _device->dispatchKeyboardMessage(_gestureMessage, &now);
+    _gestureMessage = -1;
+    _gestureAccum = 0;
+    _gestureMessageSent = false;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void ApplePS2SentelicFSP::queueRelativePointerEvent(int dx, int dy, UInt32 buttons, uint64_t now)
+{
+    //
+    // Motion with unchanged buttons is summed into one pending event for the
+    // whole packetReady pass.  A button change flushes what is pending and
+    // goes out right away, so clicks stay in order with the motion around them.
+    //
+    if (buttons == _pendingButtons)
+    {
+        _pendingDx += dx;
+        _pendingDy += dy;
+        _pendingTime = now;
+        _pendingMotion = true;
+        return;
+    }
+    flushRelativePointerEvent();
+    _pendingButtons = buttons;
+    ++_pointerEvents;
+    dispatchRelativePointerEventX(dx, dy, buttons, now);
+}
+
+void ApplePS2SentelicFSP::flushRelativePointerEvent()
+{
+    if (!_pendingMotion)
+        return;
+    ++_pointerEvents;
+    dispatchRelativePointerEventX(_pendingDx, _pendingDy, _pendingButtons, _pendingTime);
+    _pendingDx = 0;
+    _pendingDy = 0;
+    _pendingMotion = false;
+}
+
+void ApplePS2SentelicFSP::publishLatencyHistogram()
+{
+    setProperty("LatencyHistogram", _latency.bucket, sizeof(_latency.bucket));
+}
+
+void ApplePS2SentelicFSP::publishPacketTrace()
+{
+    // unroll the ring so the oldest entry comes first
+    UInt32 count = _trace.total < kFSPTraceEntries ? _trace.total : kFSPTraceEntries;
+    UInt32 oldest = _trace.total < kFSPTraceEntries ? 0 : _trace.total % kFSPTraceEntries;
+    
+    OSData* data = OSData::withCapacity(count * sizeof(FSPTraceEntry));
+    if (!data)
+        return;
+    data->appendBytes(&_trace.entry[oldest], (count - oldest) * sizeof(FSPTraceEntry));
+    data->appendBytes(&_trace.entry[0], oldest * sizeof(FSPTraceEntry));
+    setProperty("PacketTraceData", data);
+    data->release();
 }
 
 
@@ -1006,226 +806,181 @@ void ApplePS2SentelicFSP::packetReady()
 
 void ApplePS2SentelicFSP::dispatchRelativePointerEventWithPacket(UInt8* packet, UInt32 packetSize)
 {
+    //
+    // Palm on the pad: drop the motion from the raw bytes, before any
+    // decoding or time keeping, until the finger-up packet or a notify
+    // other than another palm report.
+    //
+    _dispatchType = kFSPTraceDropped;
+    if (_palmDown)
+    {
+        UInt8 type = packet[0] >> FSP_PKT_TYPE_SHIFT;
+        bool fingerUp = type == FSP_PKT_TYPE_ABS && !packet[1] && !packet[2] && !(packet[3] & 0x0f);
+        bool palm = type == FSP_PKT_TYPE_NOTIFY && packet[1] == FSP_CX_NOTIFY_MSG_TYPE_GUESTURE && packet[2] == FSP_GESTURE_PALM;
+        if (palm || (type != FSP_PKT_TYPE_NOTIFY && !fingerUp))
+        {
+            // only the motion goes; the physical buttons (not the on-pad
+            // click a palm can trigger) still get through
+            UInt32 buttons = packet[0] & (type == FSP_PKT_TYPE_NORMAL ? 0x07 :
+                                          type == FSP_PKT_TYPE_NORMAL_OPC ? 0x06 : 0x03);
+            if (type != FSP_PKT_TYPE_NOTIFY && buttons != _pendingButtons)
+                queueRelativePointerEvent(0, 0, buttons, _batchTime);
+            ++_palmSuppressed;
+            return;
+        }
+        _palmDown = false;
+    }
       
     UInt32      buttons = 0;
     SInt32      dx, dy, dz;
-    uint64_t    now_abs;
-    clock_get_uptime(&now_abs);
-    uint64_t now_ns;
-    absolutetime_to_nanoseconds(now_abs, &now_ns);
+    uint64_t    now_abs = _batchTime;
     
     int abs_x = 0, abs_y = 0;
-    int lb=0,rb=0,mb=0,fi=0,opc=0,cm=0;
-    int sl=0,sr=0,b4=0,b5=0;
+    FSPPacket   fsp;
 
     
     
     if(1)
     {
     
-        //fsp_packet_debug(packet,packetSize);
-//        return;
+        if(now_abs-keytime < maxaftertyping)
+            return;
         
+        fsp_decode_packet(packet, &fsp);
+        _dispatchType = fsp.type;
         
-        if(now_ns-keytime < maxaftertyping)
-            return;
+        if (fsp_tracker_update(&_fingers, &fsp) && fsp.type != FSP_PKT_TYPE_ABS)
+            return; // MFMC enter/leave notify
+        if (fsp.type == FSP_PKT_TYPE_ABS && fsp.multiCoord)
+        {
+            // only the first finger moves the pointer; with two fingers
+            // down, leave the pointer alone and restart tracking afterwards
+            if (fsp.finger != 0 || _fingers.finger[1].down)
+            {
+                // the fingers' common movement scrolls, once per finger 1
+                // report so each pair counts once; gesture notifies win
+                int sx, sy;
+                if (fsp.finger == 1 && !_isInGesture &&
+                    fsp_tracker_two_finger_motion(&_fingers, &sx, &sy) && (sx || sy))
+                {
+                    flushRelativePointerEvent();
+                    dispatchScrollWheelEventX(-sy, sx, 0, now_abs);
+                }
+
+                fsp_abs_reset(&_abs);
+                return;
+            }
+        }
         
-        switch (packet[0] >> FSP_PKT_TYPE_SHIFT) {
+        switch (fsp.type) {
             case FSP_PKT_TYPE_NOTIFY:
+                // scroll/gesture events must not overtake queued motion
+                flushRelativePointerEvent();
 //                dev_warn(&psmouse->ps2dev.serio->dev,
 //                         "Unexpected gesture packet, ignored.\n");
-               
-                if(MFMT_LEFT_BTN_DOWN & packet[0]) lb=1;
-                if(MFMT_RIGHT_BTN_DOWN &packet[0]) rb =1;
-                if(MFMT_MID_BTN_DOWN&packet[0]) mb=1;
-                if(MFMT_LEFT_BTN_OPC&packet[0]) opc=1;
-                
                 
-                if(packet[1]==FSP_CX_NOTIFY_MSG_TYPE_GUESTURE)
+                if(fsp.notifyType==FSP_CX_NOTIFY_MSG_TYPE_GUESTURE)
                 {
                     
-                    _last_abs_x = 0;
-                    _last_abs_y = 0;
+                    fsp_abs_reset(&_abs);
+                    
+                    if(fsp.gestureId)
+                        countGesture(fsp.gestureId, now_abs);
+                    else
+                        endGestureStats(now_abs);
                   
                     
                    
                     if(_isInGesture)
                     {
-                        dz  =  packet[3] - _last_abs_z;
+                        dz  =  fsp.gestureValue - _last_abs_z;
                     }                    
                     else
                     {
-                        dz  =  packet[3] ;
+                        dz  =  fsp.gestureValue ;
                     }
-                    _last_abs_z  = packet[3] ;
+                    _last_abs_z  = fsp.gestureValue ;
                     
                     
-                    switch (packet[2]) {
-                        case	0x86:
-                              _isInGesture=true;
-                            z_avg.setDir(SCROLL_DIR_UP);
-                            dz = z_avg.filter(dz);
-                            //IOLog("	2 finger straight up             \n");
-                            if(dz>0)
-                                dispatchScrollWheelEventX(
-                                                      dz,
-                                                      0,
-                                                      0,
-                                                      now_abs);
-                            break;
-                        case	0x82:
-                            
+                    const FSPGestureEntry& gesture = fsp_gesture_table[fsp.gestureId];
+                    switch (gesture.action) {
+                        case kFSPGestureScroll:
                             _isInGesture=true;
-                            z_avg.setDir(SCROLL_DIR_DOWN);
-                            dz = z_avg.filter(dz);
-                                //IOLog("	2 finger straight down           \n");
-                            if(dz>0)
-                                dispatchScrollWheelEventX(
-                                                      -dz,
-                                                      0,
-                                                      0,
-                                                      now_abs);
-                            break;
-                        case	0x80:
-                              _isInGesture=true;
-                            z_avg.setDir(SCROLL_DIR_RIGHT);
-                            dz = z_avg.filter(dz);
-                            //IOLog("	2 finger straight right          \n");break;
-                              //_device->dispatchKeyboardMessage(kPS2M_swipeUp, &now_abs);
-                            if(dz>0)
-                                dispatchScrollWheelEventX(
-                                                      0,
-                                                      dz,
-                                                      0,
-                                                      now_abs);
-                            break;
-                        case	0x84:
-                              _isInGesture=true;
-                            z_avg.setDir(SCROLL_DIR_LEFT);
-                            dz = z_avg.filter(dz);
-                            //IOLog("	2 finger straight left           \n");break;
-                              //_device->dispatchKeyboardMessage(kPS2M_swipeDown, &now_abs);
+                            z_avg.setDir(gesture.arg);
+                            // velocity wants when the sample was taken, not when
+                            // the batch it came in got serviced
+                            dz = z_avg.filter(dz, _packetTime);
                             if(dz>0)
-                                dispatchScrollWheelEventX(
-                                                      0,
-                                                      -dz,
-                                                      0,
-                                                      now_abs);
-                            break;
-                        case	0x8f:
-                            //IOLog("	2 finger zoom in                 \n");break;
-                            if(!_isInGesture)
-                            {
-                                _isInGesture=true;
-                                _device->dispatchKeyboardMessage(kPS2M_zoomIn, &now_abs);
-                            }
-                        case	0x8b:
-                            //IOLog("	2 finger zoom out                \n");break;
-                            if(!_isInGesture)
                             {
-                                _isInGesture=true;
-                                _device->dispatchKeyboardMessage(kPS2M_zoomOut, &now_abs);
+                                switch (gesture.arg) {
+                                    case SCROLL_DIR_UP:    dispatchScrollWheelEventX(dz, 0, 0, now_abs); break;
+                                    case SCROLL_DIR_DOWN:  dispatchScrollWheelEventX(-dz, 0, 0, now_abs); break;
+                                    case SCROLL_DIR_RIGHT: dispatchScrollWheelEventX(0, dz, 0, now_abs); break;
+                                    case SCROLL_DIR_LEFT:  dispatchScrollWheelEventX(0, -dz, 0, now_abs); break;
+                                }
                             }
-                        case	0xc0:
-                            //IOLog("	2 finger curve, counter clockwise");break;
-                            if(!_isInGesture)
-                            {
-                                _isInGesture=true;
-                                _device->dispatchKeyboardMessage(kPS2M_rotateL, &now_abs);
-                            }
-                        case	0xc4:
-                            //IOLog("	2 finger curve, clockwise        \n");break;
-                            if(!_isInGesture)
-                            {
-                                _isInGesture=true;
-                                _device->dispatchKeyboardMessage(kPS2M_rotateR, &now_abs);
-                            }
-                        case	0x2e:
-                            //IOLog("	3 finger straight up             \n");break;
-                            if(!_isInGesture)
-                            {
-                                _isInGesture=true;
-                                _device->dispatchKeyboardMessage(kPS2M_swipeUp, &now_abs);
-                            }
-                        case	0x2a:
-                            if(!_isInGesture)
-                            {
-                                //IOLog("	3 finger straight down           \n");break;
-                                 _isInGesture=true;
-                                _device->dispatchKeyboardMessage(kPS2M_swipeDown, &now_abs);
-                            }
-                        case	0x28:
-                            //IOLog("	3 finger straight right          \n");break;
+                            break;
+                            
+                        case kFSPGestureMessage:
+                            // zoom/rotate/swipe/launchpad fire once per gesture
                             if(!_isInGesture)
                             {
                                 _isInGesture=true;
-                               _device->dispatchKeyboardMessage(kPS2M_swipeRight, &now_abs);
-                            }
-                        case	0x2c:
-                            //IOLog("	3 finger straight left           \n");break;
-                            if(!_isInGesture)
-                            {
-                               _isInGesture=true;
-                               _device->dispatchKeyboardMessage(kPS2M_swipeLeft, &now_abs);
+                                _device->dispatchKeyboardMessage(fsp_gesture_message[gesture.arg], &now_abs);
                             }
-                        case 0x18:
-                            //3 fingers quick click ?
                             break;
-                        case 0x19:
-                            //3 fingers quick click
-
+                            
+                        case kFSPGestureAccumulate:
+                            // the first notify carries the absolute value, not a delta
+                            accumulateGestureMessage(fsp_gesture_message[gesture.arg], _isInGesture ? dz : 0, now_abs);
+                            _isInGesture=true;
                             break;
                             
-                        case 0x11:
-                            //2 finger click
-                            dispatchRelativePointerEventX(0, 0, 0x2
+                        case kFSPGestureRightClick:
+                            queueRelativePointerEvent(0, 0, 0x2
                                                           // right button  (bit 1 in packet)
                                                           , now_abs);
-                            dispatchRelativePointerEventX(0, 0, 0
+                            queueRelativePointerEvent(0, 0, 0
                                                           // right button  (bit 1 in packet)
                                                           , now_abs+1);
                             break;
                             
-                        case 0x1a:
-                            //3 fingers double click
-                            if(!_isInGesture)
-                            {
-                                 _isInGesture=true;
-                                 _device->dispatchKeyboardMessage(kPS2M_lauchPad, &now_abs);
-                            }
-                            break;
-                        case	0x38:
-                            //IOLog("	palm                             \n");
-                           
-                            break;
-                        case 0:
+                        case kFSPGestureEnd:
                             _isInGesture = false;
+                            flushGestureMessage(now_abs);
                             
                             if(z_avg.stop()>0)
                             {
-                                setTimerTimeout(scrollTimer,momentumscrollInteval);
+                                startMomentumScroll();
                             }
-                            gestureStopTime =now_ns;
+                            gestureStopTime =now_abs;
+                            break;
+                            
+                        case kFSPGesturePalm:
+                            _palmDown = true;
                             break;
+                            
                         default:
-                            //IOLog("	unkonw Guesture id :%x                            ",gestureId);
-                           // guesting = false;
-                         
+                            // 3 finger quick click and unknown IDs
                             break;
                     }
                     
 
                 }
-                else if(packet[1]==FSP_CX_NOTIFY_MSG_TYPE_ONE_FINGER_HOLD)
+                else if(fsp.notifyType==FSP_CX_NOTIFY_MSG_TYPE_ONE_FINGER_HOLD)
                 {
                      _isInGesture = false;
-                    gestureStopTime =now_ns;
+                    gestureStopTime =now_abs;
+                    endGestureStats(now_abs);
+                    flushGestureMessage(now_abs);
                     IOLog("FSP_CX_NOTIFY_MSG_TYPE_ONE_FINGER_HOLD\n");
                 }
                 else
                 {
                     _isInGesture = false;
-                    gestureStopTime =now_ns;
+                    gestureStopTime =now_abs;
+                    endGestureStats(now_abs);
+                    flushGestureMessage(now_abs);
                     IOLog("Unexpected gesture packet, ignored.\n");
                 }
                 break;
@@ -1234,79 +989,47 @@ void ApplePS2SentelicFSP::dispatchRelativePointerEventWithPacket(UInt8* packet,
                 /* Absolute packets are sent with version Cx and newer
                     * touchpads if register 0x90 bit 0 is set.
                     */
-                abs_x = (packet[1] << 2) | ((packet[3] >> 2) & 0x03);
-                abs_y = (packet[2] << 2) | (packet[3] & 0x03);
-                
-                if(MFMT_LEFT_BTN_DOWN & packet[0]) lb=1;
-                if(MFMT_RIGHT_BTN_DOWN &packet[0]) rb =1;
-                if(MFMT_FINGER_INDEX&packet[0]) fi=1;
-                if(MFMT_LEFT_BTN_OPC&packet[0]) opc=1;
-                if(MFMT_COORD_MODE&packet[0]) cm=1;
+                abs_x = fsp.absX;
+                abs_y = fsp.absY;
                 
-                if(MFMT_4TH_BTN&packet[3])b4=1;
-                if(MFMT_5TH_BTN&packet[3])b5=1;
-                if(MFMT_SCROLL_LEFT_BTN&packet[3])sl=1;
-                if(MFMT_SCROLL_RIGHT_BTN&packet[3]) sr =1;
+                if(abs_y==0 && abs_x==0)
+                    endGestureStats(now_abs);
                 
                 if(_isInGesture)
                 {
                     if(abs_y==0 && abs_x==0)
                     {
                         _isInGesture = false;
-                        gestureStopTime =now_ns;
-                        _last_abs_x = 0;
-                        _last_abs_y = 0;
-                        x_avg.reset();
-                        y_avg.reset();
+                        flushGestureMessage(now_abs);
+                        gestureStopTime =now_abs;
+                        fsp_abs_reset(&_abs);
                         if(z_avg.stop()>0)
                         {
-                            setTimerTimeout(scrollTimer,momentumscrollInteval);
+                            startMomentumScroll();
                         }
                     }
                     return;
                 }
                  
-                if(now_ns-gestureStopTime < scrolllockTime)
+                if(now_abs-gestureStopTime < scrolllockTime)
                 {
                     return;
                 }
                    
-                if ( lb) buttons |= 0x1;  // left button   (bit 0 in packet)
-                if ( rb ) buttons |= 0x2;  // right button  (bit 1 in packet)
-                if(!lb && !opc)
-                {
-                    buttons |= 0x1;  // onpad click
-                }
+                buttons = fsp.buttons;  // includes the onpad click
                 
                 if(abs_y==0 && abs_x==0)
                 {
                     dx = 0;
                     dy = 0;
-                    x_avg.reset();
-                    y_avg.reset();
-                    
-                }
-                else if(_last_abs_x==0 && _last_abs_y==0)
-                {
-                    dx = 0;
-                    dy = 0;
+                    fsp_abs_reset(&_abs);
                 }
                 else
-                {
-                    
-                    abs_x = x_avg.filter(abs_x);
-                    abs_y = y_avg.filter(abs_y);
-                    
-                    dx = abs_x - _last_abs_x;
-                    dy = abs_y - _last_abs_y;
-                }
+                    fsp_abs_motion(&_abs, abs_x, abs_y, &dx, &dy);  // no motion on touch down
                 
-                dispatchRelativePointerEventX(dx, dy, buttons, now_abs);
+                queueRelativePointerEvent(accelerate(dx), accelerate(dy), buttons, now_abs);
                 
                 
-                _last_abs_x = abs_x;
-                _last_abs_y = abs_y;
-                
                 break;
                 
             case FSP_PKT_TYPE_NORMAL_OPC:
@@ -1320,18 +1043,16 @@ void ApplePS2SentelicFSP::dispatchRelativePointerEventWithPacket(UInt8* packet,
                 
                 
                 if ((_touchPadModeByte == kModeByteValueGesturesEnabled) ||         // pad clicking enabled
-                    (packet[0] >> FSP_PKT_TYPE_SHIFT) != FSP_PKT_TYPE_NORMAL_OPC)   // real button
+                    fsp.type != FSP_PKT_TYPE_NORMAL_OPC)                            // real button
                 {
-                    if ( (packet[0] & 0x1) ) buttons |= 0x1;  // left button   (bit 0 in packet)
-                    if ( (packet[0] & 0x2) ) buttons |= 0x2;  // right button  (bit 1 in packet)
-                    if ( (packet[0] & 0x4) ) buttons |= 0x4;  // middle button (bit 2 in packet)
+                    buttons = fsp.buttons;
                 }
                 
-                dx = ((packet[0] & 0x10) ? 0xffffff00 : 0 ) | packet[1];
-                dy = -(((packet[0] & 0x20) ? 0xffffff00 : 0 ) | packet[2]);
+                dx = fsp.dx;
+                dy = fsp.dy;
                 
                 
-                dispatchRelativePointerEventX(dx, dy, buttons, now_abs);
+                queueRelativePointerEvent(accelerate(dx), accelerate(dy), buttons, now_abs);
                 
                 break;
         }
@@ -1383,44 +1104,21 @@ void ApplePS2SentelicFSP::setTouchPadEnable( bool enable )
     // It is safe to issue this request from the interrupt/completion context.
     //
 	
-    // (mouse enable/disable command)
-    TPS2Request<> request;
-    request.commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
-    request.commands[0].inOrOut =  enable ? kDP_Enable : kDP_SetDefaultsAndDisable;
-    request.commandsCount = 1;
-    assert(request.commandsCount <= countof(request.commands));
-    _device->submitRequestAndBlock(&request);
-	
-    // enable one-pad-click tagging, so we can filter them out!
-    fsp_opctag_enable(_device, &request, true);
-    fsp_onpad_icon(_device, &request, false);
-    int val = FSP_CX_ABSOLUTE_MODE |
-    FSP_CX_GESTURE_OUTPUT|
-    FSP_CX_2FINGERS_OUTPUT |
-    FSP_CX_FINGER_UP_OUTPUT |
-   FSP_CX_CONTINUOUS_MODE|
-    FSP_CX_GUEST_GROUP_BIT1|
-    FSP_CX_GUEST_GROUP_BIT2;
+    uint64_t start_abs, now_abs, ns;
+    clock_get_uptime(&start_abs);
     
-    fsp_reg_write(_device, &request, FSP_REG_SWREG1, val);
+    UInt32 regbytes = 0;
+    bool verified = fsp_set_enable(_device, enable, kFSPEnableSwreg1, samplerate, &_packetSize, &regbytes);
+    if (!enable)
+        return;
     
-    int fsprt = fsp_intellimouse_mode(_device, &request);
-    IOLog("fsp_intellimouse_mode retrun %d\n",fsprt);
-    // turn on intellimouse mode (4 bytes per packet)
-    if (fsprt== 4) 
-    {
-        
-        /* Enable absolute positioning, two finger mode and continuous output
-         * on Cx and newer pads (version ID 0xE0+)
-         */
-      // if (pad->ver >= 0xE0) {
-       // fsp_onpad_icon
-       
-        
-        _packetSize = 4;
-    }
+    setProperty("RegisterSetupVerified", verified);
+    setProperty("RegisterBytesExchanged", regbytes, 32);
+    setProperty("SampleRate", samplerate, 32);
     
-  
+    clock_get_uptime(&now_abs);
+    absolutetime_to_nanoseconds(now_abs - start_abs, &ns);
+    setProperty("InitTime", ns / 1000, 32);
 }
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -1483,6 +1181,41 @@ IOReturn ApplePS2SentelicFSP::setParamProperties( OSDictionary * dict )
 {
     
     OSNumber * clicking = OSDynamicCast( OSNumber, dict->getObject("Clicking") );
+    
+    if (dict->getObject("ResetLatencyHistogram"))
+    {
+        _latency.reset();
+        publishLatencyHistogram();
+    }
+    
+    // acceleration, same parameters as accel in the Linux sentelic driver
+    static const struct { const char* name; int ApplePS2SentelicFSP::* var; } accelvars[] =
+    {
+        { "AccelNumerator",   &ApplePS2SentelicFSP::accelnum },
+        { "AccelDenominator", &ApplePS2SentelicFSP::acceldenom },
+        { "AccelThreshold",   &ApplePS2SentelicFSP::accelthreshold },
+    };
+    bool accelChanged = false;
+    for (int i = 0; i < countof(accelvars); i++)
+    {
+        OSNumber * num = OSDynamicCast( OSNumber, dict->getObject(accelvars[i].name) );
+        if ( num )
+        {
+            this->*accelvars[i].var = num->unsigned32BitValue();
+            setProperty(accelvars[i].name, num);
+            accelChanged = true;
+        }
+    }
+    if ( accelChanged )
+        buildAccelTable();
+    
+    OSBoolean * trace = OSDynamicCast( OSBoolean, dict->getObject("PacketTrace") );
+    if ( trace )
+    {
+        _trace.enabled = trace->isTrue();
+        _trace.reset();
+        setProperty("PacketTrace", trace);
+    }
 	
     if ( clicking )
     {
@@ -1510,6 +1243,23 @@ IOReturn ApplePS2SentelicFSP::setParamProperties( OSDictionary * dict )
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2SentelicFSP::buildAccelTable()
+{
+    //
+    // Deltas larger than accelthreshold are scaled by accelnum/acceldenom,
+    // like the Linux driver does.  Done once here so the packet path only
+    // indexes _accelTable.
+    //
+    if (accelnum <= 0)
+        accelnum = 1;
+    if (acceldenom <= 0)
+        acceldenom = 1;
+    for (int d = 0; d < kFSPAccelTableSize; d++)
+        _accelTable[d] = d > accelthreshold ? d * accelnum / acceldenom : d;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 void ApplePS2SentelicFSP::setDevicePowerState( UInt32 whatToDo )
 {
     switch ( whatToDo )
@@ -1530,15 +1280,19 @@ void ApplePS2SentelicFSP::setDevicePowerState( UInt32 whatToDo )
             // completed its power-on self-test and calibration.
             //
 			
-            IOSleep(1000);
+            waitForDeviceReady();
 			
             //
             // Clear packet buffer pointer to avoid issues caused by
             // stale packet fragments.
             //
 			
-            _packetByteCount = 0;
+            fsp_assembler_reset(&_assembler);
             _ringBuffer.reset();
+            _packetTimes.reset();
+            fsp_tracker_reset(&_fingers);
+            _palmDown = false;
+            _gestureMessage = -1;
 			
             //
             // Finally, we enable the trackpad itself, so that it may
@@ -1552,6 +1306,39 @@ void ApplePS2SentelicFSP::setDevicePowerState( UInt32 whatToDo )
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+void ApplePS2SentelicFSP::waitForDeviceReady()
+{
+    //
+    // Poll the device ID register until the pad answers, instead of always
+    // sleeping for the worst case.  Gives up after wakedelay ms.
+    //
+    
+    TPS2Request<kFSPRegReadCommands> request;
+    uint64_t start, now, ns;
+    bool ready = false;
+    
+    clock_get_uptime(&start);
+    ns = 0;
+    while (ns < (uint64_t)wakedelay * 1000000)
+    {
+        IOSleep(kFSPWakePollInterval);
+        if (fsp_reg_read(_device, &request, FSP_REG_DEVICE_ID) == FSP_DEVICE_MAGIC)
+        {
+            ready = true;
+            break;
+        }
+        clock_get_uptime(&now);
+        absolutetime_to_nanoseconds(now - start, &ns);
+    }
+    
+    clock_get_uptime(&now);
+    absolutetime_to_nanoseconds(now - start, &ns);
+    setProperty("WakeReadyTime", ns / 1000000, 32);
+    DEBUG_LOG("%s: pad %s after %lld ms\n", getName(), ready ? "ready" : "not ready", ns / 1000000);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
 bool ApplePS2SentelicFSP::setTouchPadModeByte(UInt8 modeByteValue, bool enableStreamMode)
 {
     TPS2Request<12> request;
@@ -1674,12 +1461,12 @@ void ApplePS2SentelicFSP::receiveMessage(int message, void* data)
                         
                     }
                     _modifierdown &= ~masks[pInfo->adbKeyCode-0x36];
-                    keytime = pInfo->time;
+                    nanoseconds_to_absolutetime(pInfo->time, &keytime);
                     break;
                     
                 default:
                     gestureStopTime = 0;  // keys cancel momentum scroll
-                    keytime = pInfo->time;
+                    nanoseconds_to_absolutetime(pInfo->time, &keytime);
             }
             break;
         }
@@ -25,6 +25,8 @@
 
 #include "ApplePS2MouseDevice.h"
 #include <IOKit/hidsystem/IOHIPointing.h>
+#include "VoodooPS2SentelicFSPDecoder.h"
+#include "VoodooPS2SentelicFSPRegisters.h"
 
 
 
@@ -33,118 +35,99 @@
 #define kPacketLengthStandard     3
 #define kPacketLengthLarge        4
 
+// pointer acceleration is looked up for deltas below this, computed above
+#define kFSPAccelTableSize        256
 
+// poll interval (ms) while waiting for the pad after wake
+#define kFSPWakePollInterval      20
 
 
-template <class T, int N>
-class SimpleAverage2
+
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// FSPLatencyHistogram
+//
+// Counts packet latencies (first byte received -> HID event dispatched) in
+// log2 buckets: bucket n holds [2^n, 2^(n+1)) microseconds, the last bucket
+// everything above.
+//
+
+#define kFSPLatencyBuckets 16
+
+class FSPLatencyHistogram
 {
-private:
-    T m_buffer[N];
-    int m_count;
-    int m_sum;
-    int m_index;
-    
 public:
-    inline SimpleAverage2() { reset(); }
-    T filter(T data)
-    {
-        // add new entry to sum
-        m_sum += data;
-        // if full buffer, then we are overwriting, so subtract old from sum
-        if (m_count == N)
-            m_sum -= m_buffer[m_index];
-        // new entry into buffer
-        m_buffer[m_index] = data;
-        // move index to next position with wrap around
-        if (++m_index >= N)
-            m_index = 0;
-        // keep count moving until buffer is full
-        if (m_count < N)
-            ++m_count;
-        // return average of current items
-        return m_sum / m_count;
-    }
-    inline void reset()
-    {
-        m_count = 0;
-        m_sum = 0;
-        m_index = 0;
-    }
-    inline int count() { return m_count; }
-    inline int sum() { return m_sum; }
-    T oldest()
-    {
-        // undefined if nothing in here, return zero
-        if (m_count == 0)
-            return 0;
-        // if it is not full, oldest is at index 0
-        // if full, it is right where the next one goes
-        if (m_count < N)
-            return m_buffer[0];
-        else
-            return m_buffer[m_index];
-    }
-    T newest()
-    {
-        // undefined if nothing in here, return zero
-        if (m_count == 0)
-            return 0;
-        // newest is index - 1, with wrap
-        int index = m_index;
-        if (--index < 0)
-            index = m_count-1;
-        return m_buffer[index];
-    }
-    T average()
+    UInt32 bucket[kFSPLatencyBuckets];
+    
+    inline FSPLatencyHistogram() { reset(); }
+    inline void reset() { memset(bucket, 0, sizeof(bucket)); }
+    inline void record(uint64_t ns)
     {
-        if (m_count == 0)
-            return 0;
-        return m_sum / m_count;
+        uint64_t us = ns / 1000;
+        int n = us ? 63 - __builtin_clzll(us) : 0;
+        if (n >= kFSPLatencyBuckets)
+            n = kFSPLatencyBuckets-1;
+        ++bucket[n];
     }
 };
 
 
-#define SCROLL_DIR_UP 1
-#define SCROLL_DIR_DOWN 2
-#define SCROLL_DIR_LEFT 3
-#define SCROLL_DIR_RIGHT 4
-
-#define SCROLL_DELTA_EVEN 0
-#define SCROLL_DELTA_INSCREASE 1
-#define SCROLL_DELTA_DESCREASE 2
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// FSPTraceRing
+//
+// Raw record of the last kFSPTraceEntries packets, published as the
+// PacketTraceData property (array of FSPTraceEntry, oldest first).
+//
 
+#define kFSPTraceEntries 256
+#define kFSPTraceDropped 0xff           // dropped before decoding (palm, typing)
 
-#define SCROLL_DELTA_FACTOR 32
+struct FSPTraceEntry
+{
+    uint64_t time;                      // uptime of byte 0, absolute time units
+    UInt8    packet[kPacketLengthMax];
+    UInt8    type;                      // decoded FSP_PKT_TYPE_* or kFSPTraceDropped
+    UInt8    size;                      // valid bytes in packet
+    UInt8    reserved[2];
+};
 
-class ScrollSmoother
+class FSPTraceRing
 {
-private:
-    uint64_t lastinputTime;
-    uint64_t lastspeedCalcTime;
-    int  direction; //0 up, 1 down, 2 , left, 3 right
-    int  history[2];
-    int  lastDelta;
-    int  cur_history_index;
-    int  deltaDir; // 0- verage 1->increase  2- decress
-    int  inputCount;
-    int  stopDelta;
-    int  decDelta;
-    int  maxDelta;
 public:
-    ScrollSmoother();
-    ~ScrollSmoother();
-    double getSpeed();
-    int   getDelta();
-    int   getDir();
-    void  setDir(int dir);
-    int   filter(int dz);
-    int   stop();
-    int   getFlingDelta();
+    bool          enabled;
+    UInt32        total;                // packets recorded since reset
+    FSPTraceEntry entry[kFSPTraceEntries];
     
+    inline FSPTraceRing() { enabled = false; total = 0; }
+    inline void reset() { total = 0; }
+    inline void record(uint64_t time, const UInt8* packet, UInt8 size, UInt8 type)
+    {
+        FSPTraceEntry* e = &entry[total++ % kFSPTraceEntries];
+        e->time = time;
+        memcpy(e->packet, packet, kPacketLengthMax);
+        e->type = type;
+        e->size = size;
+    }
+};
+
+
+// per gesture ID counters, published as GestureStatistics
+struct FSPGestureStats
+{
+    UInt32   count;         // gestures seen
+    UInt32   packets;       // notify packets over all of them
+    uint64_t duration;      // total, absolute time units
 };
 
+#define SCROLL_DIR_UP FSP_SCROLL_UP
+#define SCROLL_DIR_DOWN FSP_SCROLL_DOWN
+#define SCROLL_DIR_LEFT FSP_SCROLL_LEFT
+#define SCROLL_DIR_RIGHT FSP_SCROLL_RIGHT
 
+// momentum timer interval doubles (up to kFSPFlingMaxTicks times the base
+// interval) while the per-step fling delta is below kFSPFlingStretchDelta
+#define kFSPFlingStretchDelta  (SCROLL_DELTA_FACTOR*2)
+#define kFSPFlingMaxTicks      8
 
 
 
@@ -163,31 +146,72 @@ private:
     bool                  _powerControlHandlerInstalled;
     bool                _messageHandlerInstalled;
     RingBuffer<UInt8, kPacketLengthMax*32> _ringBuffer;
-    UInt32                _packetByteCount;
+    FSPAssembler          _assembler;           // bytes of the packet being collected
     UInt8                 _packetSize;
     IOFixed               _resolution;
     IOFixed                 _scrollresolution;
     UInt16                _touchPadVersion;
     UInt8                 _touchPadModeByte;
     UInt8                 _buttons;
+    RingBuffer<uint64_t, 32> _packetTimes;      // arrival of byte 0, per queued packet
+    uint64_t              _batchTime;           // uptime at the start of packetReady
+    uint64_t              _packetTime;          // arrival of the packet being dispatched
+    uint64_t              _rateWindowStart;     // see interruptOccurred
+    UInt32                _rateCount;
+    UInt32                _measuredRate;        // packets/sec
+    UInt32                _packetsReceived;
+    UInt32                _pointerEvents;       // dispatchRelativePointerEvent calls
+    bool                  _pendingMotion;       // see queueRelativePointerEvent
+    int                   _pendingDx;
+    int                   _pendingDy;
+    UInt32                _pendingButtons;      // also the last button state sent
+    uint64_t              _pendingTime;
+    bool                  _palmDown;            // palm gesture seen, waiting for finger up
+    UInt32                _palmSuppressed;
+    int                   _gestureMessage;      // kPS2M_* being accumulated, -1 if none
+    int                   _gestureAccum;
+    bool                  _gestureMessageSent;
+    UInt32                _gestureMessagesSuppressed;
+    FSPGestureStats       _gestureStats[256];   // by gesture ID
+    bool                  _gestureActive;
+    UInt8                 _gestureId;
+    uint64_t              _gestureStart;
+    bool                  _gestureStatsDirty;
+    FSPLatencyHistogram   _latency;
+    uint64_t              _latencyPublishTime;
+    uint64_t              _latencyPublishInterval;
+    FSPTraceRing          _trace;
+    UInt8                 _dispatchType;        // what dispatch made of the last packet, for _trace
+    int                   wakedelay;            // upper bound (ms) for waitForDeviceReady
+    int                   scrollHistoryDepth;   // samples used by z_avg velocity estimate
+    int                   momentumscrollmultiplier;
+    int                   momentumscrolldivisor;
+    int                   momentumscrollthreshold;
+    int                   samplerate;           // reports/sec set on enable, 0 keeps the pad's own
+    int                   accelnum;             // see buildAccelTable
+    int                   acceldenom;
+    int                   accelthreshold;
+    int                   zoomrotatethreshold;  // see accumulateGestureMessage
+    int                   _accelTable[kFSPAccelTableSize];
     
     
     int _modifierdown; // state of left+right control keys
-    int                     _last_abs_x;
-    int                     _last_abs_y;
     int                     _last_abs_z;
+    FSPAbsFilter            _abs;         // pointer motion from abs packets
     bool                    _isInGesture;
+    FSPFingerTracker        _fingers;
     
     
-    SimpleAverage2<int, 3> x_avg;
-    SimpleAverage2<int, 3> y_avg;
     ScrollSmoother           z_avg;
+    // times and thresholds below are in absolute time units
     uint64_t keytime;
     uint64_t gestureStopTime;
     uint64_t momentumscrollInteval;
     uint64_t maxaftertyping ;
     uint64_t  scrolllockTime;
     IOTimerEventSource* scrollTimer;
+    int      _flingTicks;           // decay steps per scrollTimer fire
+    UInt32   _flingTimerFires;      // scrollTimer fires in the current fling
     virtual void   dispatchRelativePointerEventWithPacket( UInt8 * packet, UInt32  packetSize ); 
     
     virtual void   setTouchPadEnable( bool enable );
@@ -197,7 +221,26 @@ private:
     
     virtual PS2InterruptResult interruptOccurred(UInt8 data);
     virtual void packetReady();
+    void   recordLatency(uint64_t start[], int& count, uint64_t* now_abs);
+    void   countGesture(UInt8 id, uint64_t now);
+    void   endGestureStats(uint64_t now);
+    void   accumulateGestureMessage(int message, int dz, uint64_t now);
+    void   flushGestureMessage(uint64_t now);
+    void   publishGestureStats();
+    void   queueRelativePointerEvent(int dx, int dy, UInt32 buttons, uint64_t now);
+    void   flushRelativePointerEvent();
+    void   publishLatencyHistogram();
+    void   publishPacketTrace();
     virtual void   setDevicePowerState(UInt32 whatToDo);
+    void   waitForDeviceReady();
+    void   buildAccelTable();
+    inline int accelerate(int d)
+    {
+        int a = d < 0 ? -d : d;
+        if (a < kFSPAccelTableSize)
+            return d < 0 ? -_accelTable[a] : _accelTable[a];
+        return a > accelthreshold ? d * accelnum / acceldenom : d;
+    }
     virtual void   receiveMessage(int message, void* data);
 protected:
     virtual IOItemCount buttonCount();
@@ -221,6 +264,7 @@ public:
     virtual UInt32 deviceType();
     virtual UInt32 interfaceID();
     void onScrollTimer(void);
+    void startMomentumScroll();
     virtual IOReturn setParamProperties( OSDictionary * dict );
     
     
@@ -0,0 +1,603 @@
+//
+//  VoodooPS2SentelicFSPDecoder.cpp
+//
+//  Decoding of Sentelic FSP 4-byte packets (see fsp-lnxdrv-code/doc/fsp_packet.txt)
+//  and the byte sequences of the register access protocol.
+//
+//  Nothing in here depends on IOKit or the kernel, so the same code can be
+//  compiled and exercised in a user space program on any host.
+//
+
+#include "VoodooPS2SentelicFSPDecoder.h"
+
+#include <string.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void fsp_decode_packet(const uint8_t packet[4], FSPPacket* result)
+{
+    result->type = packet[0] >> FSP_PKT_TYPE_SHIFT;
+    result->buttons = 0;
+    
+    switch (result->type)
+    {
+        case FSP_PKT_TYPE_ABS:
+            /* Absolute packets are sent with version Cx and newer
+             * touchpads if register 0x90 bit 0 is set.
+             */
+            result->absX = (packet[1] << 2) | ((packet[3] >> 2) & 0x03);
+            result->absY = (packet[2] << 2) | (packet[3] & 0x03);
+            result->finger = (packet[0] & MFMT_FINGER_INDEX) ? 1 : 0;
+            result->multiCoord = (packet[0] & MFMT_COORD_MODE) != 0;
+            result->extButtons = packet[3] & 0xf0;
+            
+            if (packet[0] & MFMT_LEFT_BTN_DOWN)
+                result->buttons |= 0x1;  // left button   (bit 0 in packet)
+            if (packet[0] & MFMT_RIGHT_BTN_DOWN)
+                result->buttons |= 0x2;  // right button  (bit 1 in packet)
+            // left button generated by on-pad command
+            if (!(packet[0] & (MFMT_LEFT_BTN_DOWN | MFMT_LEFT_BTN_OPC)))
+                result->buttons |= 0x1;
+            break;
+            
+        case FSP_PKT_TYPE_NOTIFY:
+            if (packet[0] & MFMT_LEFT_BTN_DOWN)
+                result->buttons |= 0x1;
+            if (packet[0] & MFMT_RIGHT_BTN_DOWN)
+                result->buttons |= 0x2;
+            if (packet[0] & MFMT_MID_BTN_DOWN)
+                result->buttons |= 0x4;
+            result->notifyType = packet[1];
+            result->gestureId = packet[2];
+            result->gestureValue = packet[3];
+            break;
+            
+        case FSP_PKT_TYPE_NORMAL_OPC:
+            /* on-pad click, caller decides whether to filter it */
+            /* fall through */
+            
+        case FSP_PKT_TYPE_NORMAL:
+            /* normal packet */
+            if (packet[0] & 0x1)
+                result->buttons |= 0x1;  // left button   (bit 0 in packet)
+            if (packet[0] & 0x2)
+                result->buttons |= 0x2;  // right button  (bit 1 in packet)
+            if (packet[0] & 0x4)
+                result->buttons |= 0x4;  // middle button (bit 2 in packet)
+            result->dx = ((packet[0] & 0x10) ? 0xffffff00 : 0 ) | packet[1];
+            result->dy = -(((packet[0] & 0x20) ? 0xffffff00 : 0 ) | packet[2]);
+            break;
+    }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// Checks the bits that are fixed for every packet type.  A packet that fails
+// means the byte stream has lost its packet boundary.  Only byte 0 bit 3 and
+// the notify message type are fixed; abs and relative packets use every
+// other bit for data, so a slip that lands on one of those is only caught
+// by a later packet.
+bool fsp_packet_plausible(const uint8_t packet[4])
+{
+    if (!(packet[0] & MFMT_PS2_SPECIFY))
+        return false;
+    
+    if ((packet[0] >> FSP_PKT_TYPE_SHIFT) == FSP_PKT_TYPE_NOTIFY)
+    {
+        // byte 1 is one of the known message types
+        switch (packet[1])
+        {
+            case FSP_CX_NOTIFY_MSG_TYPE_GUESTURE:
+            case FSP_CX_NOTIFY_MSG_TYPE_ONE_FINGER_HOLD:
+            case FSP_CX_NOTIFY_MSG_TYPE_MFMC:
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static inline bool fsp_can_start_packet(uint8_t data)
+{
+    return data != 0xfa && (data & MFMT_PS2_SPECIFY);
+}
+
+// drops a fragment, the resync count is kept
+void fsp_assembler_reset(FSPAssembler* assembler)
+{
+    assembler->count = 0;
+}
+
+int fsp_assemble_byte(FSPAssembler* assembler, uint8_t packet[FSP_PACKET_MAX], int packetSize,
+                      uint8_t data, uint64_t time)
+{
+    //
+    // packetSize can drop below a fragment already collected (packet mode
+    // switched while bytes were arriving).  Never let the write run past the
+    // packet; drop the fragment and treat this byte as a new start.
+    //
+    if (packetSize > FSP_PACKET_MAX)
+        packetSize = FSP_PACKET_MAX;
+    if (assembler->count >= packetSize)
+    {
+        ++assembler->resyncs;
+        assembler->count = 0;
+    }
+
+    if (assembler->count == 0 && !fsp_can_start_packet(data))
+        return kFSPAssembleDropped;
+
+    assembler->times[assembler->count] = time;
+    packet[assembler->count++] = data;
+    if (assembler->count < packetSize)
+        return kFSPAssembleBuffering;
+
+    if (!fsp_packet_plausible(packet))
+    {
+        //
+        // Lost the packet boundary (dropped byte).  Slide the packet to the
+        // next byte that could start one and keep collecting from there.
+        //
+        ++assembler->resyncs;
+        int skip = 1;
+        while (skip < assembler->count && !fsp_can_start_packet(packet[skip]))
+            ++skip;
+        for (int i = skip; i < assembler->count; i++)
+        {
+            packet[i - skip] = packet[i];
+            assembler->times[i - skip] = assembler->times[i];
+        }
+        assembler->count -= skip;
+        return kFSPAssembleResync;
+    }
+
+    assembler->start = assembler->times[0];
+    assembler->count = 0;
+    return kFSPAssembleReady;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void fsp_tracker_reset(FSPFingerTracker* tracker)
+{
+    tracker->active = false;
+    tracker->count = 0;
+    for (int i = 0; i < FSP_MAX_FINGERS; i++)
+    {
+        tracker->finger[i].down = false;
+        tracker->finger[i].x = tracker->finger[i].y = 0;
+        tracker->finger[i].dx = tracker->finger[i].dy = 0;
+    }
+}
+
+// returns true if the packet belongs to the MFMC stream
+bool fsp_tracker_update(FSPFingerTracker* tracker, const FSPPacket* packet)
+{
+    if (packet->type == FSP_PKT_TYPE_NOTIFY)
+    {
+        if (packet->notifyType != FSP_CX_NOTIFY_MSG_TYPE_MFMC)
+            return false;
+        // byte 3: bit 5~4 number of fingers, bit 0 enter/leave
+        bool enter = packet->gestureId & 0x01;
+        fsp_tracker_reset(tracker);
+        tracker->active = enter;
+        tracker->count = enter ? (packet->gestureId >> 4) & 0x03 : 0;
+        return true;
+    }
+    
+    if (packet->type != FSP_PKT_TYPE_ABS)
+        return false;
+    
+    if (!packet->multiCoord)
+    {
+        // SFAC 0/0 means every finger is up
+        if (packet->absX == 0 && packet->absY == 0)
+        {
+            bool wasActive = tracker->active;
+            fsp_tracker_reset(tracker);
+            return wasActive;
+        }
+        return false;
+    }
+    
+    FSPFinger* f = &tracker->finger[packet->finger];
+    if (packet->absX == 0 && packet->absY == 0)
+    {
+        f->down = false;
+        f->dx = f->dy = 0;
+    }
+    else
+    {
+        f->dx = f->down ? packet->absX - f->x : 0;
+        f->dy = f->down ? packet->absY - f->y : 0;
+        f->x = packet->absX;
+        f->y = packet->absY;
+        f->down = true;
+    }
+    tracker->active = true;
+    return true;
+}
+
+// average movement of both fingers, false unless both are down
+bool fsp_tracker_two_finger_motion(const FSPFingerTracker* tracker, int* dx, int* dy)
+{
+    const FSPFinger* f0 = &tracker->finger[0];
+    const FSPFinger* f1 = &tracker->finger[1];
+    if (!f0->down || !f1->down)
+        return false;
+    *dx = (f0->dx + f1->dx) / 2;
+    *dy = (f0->dy + f1->dy) / 2;
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void fsp_abs_start(FSPAbsAxis* axis, int pos)
+{
+    axis->count = axis->index = axis->sum = 0;
+    axis->last = pos << FSP_SUBPIXEL_SHIFT;
+    axis->rem = 0;
+}
+
+static int fsp_abs_delta(FSPAbsAxis* axis, int pos)
+{
+    axis->sum += pos;
+    if (axis->count == FSP_ABS_AVERAGE)
+        axis->sum -= axis->sample[axis->index];
+    else
+        ++axis->count;
+    axis->sample[axis->index] = pos;
+    if (++axis->index == FSP_ABS_AVERAGE)
+        axis->index = 0;
+    
+    // round to the nearest count; what is left over (at most half a count
+    // either way) goes into the next delta
+    const int half = 1 << (FSP_SUBPIXEL_SHIFT - 1);
+    int f = (axis->sum << FSP_SUBPIXEL_SHIFT) / axis->count;
+    int m = f - axis->last + axis->rem;
+    int d = (m + (m < 0 ? -half : half)) / (1 << FSP_SUBPIXEL_SHIFT);
+    axis->rem = m - d * (1 << FSP_SUBPIXEL_SHIFT);
+    axis->last = f;
+    return d;
+}
+
+// finger up, or the finger stopped driving the pointer
+void fsp_abs_reset(FSPAbsFilter* filter)
+{
+    filter->down = false;
+}
+
+// false (and no motion) for the first packet of a touch
+bool fsp_abs_motion(FSPAbsFilter* filter, int absX, int absY, int* dx, int* dy)
+{
+    if (!filter->down)
+    {
+        filter->down = true;
+        fsp_abs_start(&filter->x, absX);
+        fsp_abs_start(&filter->y, absY);
+        *dx = *dy = 0;
+        return false;
+    }
+    *dx = fsp_abs_delta(&filter->x, absX);
+    *dy = fsp_abs_delta(&filter->y, absY);
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+ScrollSmoother::ScrollSmoother(){
+    lastinputTime = 0;
+    lastspeedCalcTime = 0;
+    direction = 0;
+    memset(history, 0, sizeof(history));
+    lastDelta = 0;
+    cur_history_index = 0;
+    deltaDir = SCROLL_DELTA_EVEN;
+    inputCount = 0;
+    stopDelta = 0;
+    decDelta = 0;
+    maxDelta = 0;
+    flingInterval = 0;
+    flingMultiplier = kFSPFlingMultiplier;
+    flingDivisor = kFSPFlingDivisor;
+    flingThreshold = 0;
+}
+
+ScrollSmoother::~ScrollSmoother(){
+    
+}
+
+void ScrollSmoother::setHistoryDepth(int depth)
+{
+    dz_history.setDepth(depth);
+    time_history.setDepth(depth);
+}
+
+void ScrollSmoother::setFlingInterval(uint64_t interval)
+{
+    flingInterval = interval;
+}
+
+// false if the ratio was replaced by kFSPFlingMultiplier/kFSPFlingDivisor
+bool ScrollSmoother::setFlingDecay(int multiplier, int divisor, int threshold)
+{
+    // a ratio of 1 or more never decays and the fling would run forever
+    bool valid = divisor > 0 && multiplier >= 0 && multiplier < divisor;
+    if (!valid)
+    {
+        multiplier = kFSPFlingMultiplier;
+        divisor = kFSPFlingDivisor;
+    }
+    flingMultiplier = multiplier;
+    flingDivisor = divisor;
+    flingThreshold = threshold > 0 ? threshold : 0;
+    return valid;
+}
+
+int ScrollSmoother::getSpeed(){
+    //
+    // Scroll distance (in filter output units) covered per fling interval,
+    // averaged over the samples in the history window.  Same idea as
+    // dy_history/time_history in the Synaptics driver.
+    //
+    uint64_t span = time_history.newest() - time_history.oldest();
+    if (dz_history.count() < 2 || !span || !flingInterval)
+        return 0;
+    // the oldest sample happened at the start of the span, leave it out
+    int64_t dist = (int64_t)(dz_history.sum() - dz_history.oldest()) * SCROLL_DELTA_FACTOR;
+    return (int)(dist * (int64_t)flingInterval / (int64_t)span);
+}
+
+int ScrollSmoother::getDelta(){
+    
+    return 0;
+}
+
+int ScrollSmoother::getDir()
+{
+    return this->direction;
+}
+
+
+int  ScrollSmoother::filter(int z, uint64_t now)
+{
+    dz_history.filter(z);
+    time_history.add(now);
+    
+    if(z>0&& stopDelta>0)
+    {
+        stopDelta = 0;
+    }
+
+    if(cur_history_index>= (int)(sizeof(history)/sizeof(int)))
+    {
+        cur_history_index=0;
+    }
+    history[cur_history_index++] = z;
+    
+    lastinputTime = now;
+    
+    inputCount ++;
+    
+    
+    
+    if(inputCount%2==1)
+    {
+        if(inputCount>2)
+        {
+            
+            return lastDelta * SCROLL_DELTA_FACTOR;
+        }
+        else
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        int dz = (history[1] + history[0])/2;
+        
+        if(lastDelta > dz)
+            deltaDir = SCROLL_DELTA_DESCREASE;
+        else if(lastDelta<dz)
+            deltaDir = SCROLL_DELTA_INSCREASE;
+        else
+            deltaDir = SCROLL_DELTA_EVEN;
+        
+        if(dz>maxDelta)
+        {
+            maxDelta  =z;
+        }
+        
+        return dz* SCROLL_DELTA_FACTOR;
+    }
+    
+    
+    
+    return 0;
+}
+
+int  ScrollSmoother::stop(){
+    if(lastinputTime!=0)
+    {
+     //   IOLog("stop delta = %d\n",lastDelta);
+        // only a short flick flings, a long deliberate scroll just stops;
+        // the fling starts at the measured speed, the peak delta if none
+        if(inputCount<10)
+        {
+            int speed = getSpeed();
+            stopDelta = speed>0 ? speed : maxDelta*SCROLL_DELTA_FACTOR;
+        }
+        
+        decDelta =1;
+        lastDelta = 0;
+        cur_history_index = 0 ;
+        lastinputTime = 0;
+        lastspeedCalcTime = 0;
+        inputCount = 0;
+        maxDelta = 0;
+        memset(history, 0, sizeof(history));
+        dz_history.reset();
+        time_history.reset();
+        return stopDelta;
+    }
+    else
+    {
+        return 0;
+    }
+    
+}
+
+void ScrollSmoother::setDir(int dir)
+{
+    this->direction  = dir;
+}
+
+
+bool ScrollSmoother::isFlinging()
+{
+    return stopDelta>flingThreshold;
+}
+
+int  ScrollSmoother::getFlingDelta()
+{
+    if(stopDelta>flingThreshold)
+    {
+        stopDelta = (int)((int64_t)stopDelta*flingMultiplier/flingDivisor);
+        if(stopDelta<=flingThreshold)
+            stopDelta = 0;
+        return stopDelta;
+      
+    }
+    return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static const struct
+{
+    uint8_t id;
+    FSPGestureEntry entry;
+} fsp_gesture_list[] =
+{
+    { 0x86, { kFSPGestureScroll,     FSP_SCROLL_UP } },          // 2 finger straight up
+    { 0x82, { kFSPGestureScroll,     FSP_SCROLL_DOWN } },        // 2 finger straight down
+    { 0x80, { kFSPGestureScroll,     FSP_SCROLL_RIGHT } },       // 2 finger straight right
+    { 0x84, { kFSPGestureScroll,     FSP_SCROLL_LEFT } },        // 2 finger straight left
+    { 0x8f, { kFSPGestureAccumulate, kFSPMessageZoomIn } },      // 2 finger zoom in
+    { 0x8b, { kFSPGestureAccumulate, kFSPMessageZoomOut } },     // 2 finger zoom out
+    { 0xc0, { kFSPGestureAccumulate, kFSPMessageRotateL } },     // 2 finger curve, counter clockwise
+    { 0xc4, { kFSPGestureAccumulate, kFSPMessageRotateR } },     // 2 finger curve, clockwise
+    { 0x2e, { kFSPGestureMessage,    kFSPMessageSwipeUp } },     // 3 finger straight up
+    { 0x2a, { kFSPGestureMessage,    kFSPMessageSwipeDown } },   // 3 finger straight down
+    { 0x28, { kFSPGestureMessage,    kFSPMessageSwipeRight } },  // 3 finger straight right
+    { 0x2c, { kFSPGestureMessage,    kFSPMessageSwipeLeft } },   // 3 finger straight left
+    { 0x1a, { kFSPGestureMessage,    kFSPMessageLaunchPad } },   // 3 fingers double click
+    { 0x11, { kFSPGestureRightClick, 0 } },                      // 2 finger click
+    { 0x00, { kFSPGestureEnd,        0 } },                      // gesture finished
+    { FSP_GESTURE_PALM, { kFSPGesturePalm, 0 } },                // palm
+    // 0x18/0x19 (3 fingers quick click) are ignored
+};
+
+FSPGestureEntry fsp_gesture_table[256];
+
+void fsp_gesture_table_init()
+{
+    for (unsigned i = 0; i < sizeof(fsp_gesture_list)/sizeof(fsp_gesture_list[0]); i++)
+        fsp_gesture_table[fsp_gesture_list[i].id] = fsp_gesture_list[i].entry;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+const char * fsp_get_guesture_name_by_id(int gestureId)
+{
+    /*
+     ID	Description
+     0x86	2 finger straight up
+     0x82	2 finger straight down
+     0x80	2 finger straight right
+     0x84	2 finger straight left
+     0x8f	2 finger zoom in
+     0x8b	2 finger zoom out
+     0xc0	2 finger curve, counter clockwise
+     0xc4	2 finger curve, clockwise
+     0x2e	3 finger straight up
+     0x2a	3 finger straight down
+     0x28	3 finger straight right
+     0x2c	3 finger straight left
+     0x38	palm
+     */
+    
+    switch (gestureId) {
+        case	0x86:	return ("	2 finger straight up             ");break;
+        case	0x82:	return ("	2 finger straight down           ");break;
+        case	0x80:	return ("	2 finger straight right          ");break;
+        case	0x84:	return ("	2 finger straight left           ");break;
+        case	0x8f:	return ("	2 finger zoom in                 ");break;
+        case	0x8b:	return ("	2 finger zoom out                ");break;
+        case	0xc0:	return ("	2 finger curve, counter clockwise");break;
+        case	0xc4:	return ("	2 finger curve, clockwise        ");break;
+        case	0x2e:	return ("	3 finger straight up             ");break;
+        case	0x2a:	return ("	3 finger straight down           ");break;
+        case	0x28:	return ("	3 finger straight right          ");break;
+        case	0x2c:	return ("	3 finger straight left           ");break;
+        case	0x38:	return ("	palm                             ");break;
+        default:
+            return         ("unkonw Guesture id               ");
+            break;
+    }
+    
+    
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Register and data bytes that collide with sample rates or PS/2 commands are
+// sent swapped or inverted, announced by a different select byte.
+//
+
+static int fsp_mangle(int val, int select, int swapselect, int invertselect, int * mangled)
+{
+    if (val == 10 || val == 20 || val == 40 || val == 60 || val == 80 || val == 100 || val == 200) {
+        *mangled = ((val >> 4) | (val << 4)) & 0xff;
+        return swapselect;
+    } else if (val == 0xe9 || val == 0xee || val == 0xf2 || val == 0xff) {
+        *mangled = ~val & 0xff;
+        return invertselect;
+    }
+    *mangled = val;
+    return select;
+}
+
+int fsp_reg_read_sequence(int reg, uint8_t sequence[FSP_REG_SEQUENCE_BYTES])
+{
+    int register_value;
+    int register_select = fsp_mangle(reg, 0x66, 0xCC, 0x68, &register_value);
+    
+    sequence[0] = 0xf3;
+    sequence[1] = 0x66;
+    sequence[2] = 0x88;
+    sequence[3] = 0xf3;
+    sequence[4] = register_select;
+    sequence[5] = register_value;
+    return FSP_REG_SEQUENCE_BYTES;
+}
+
+int fsp_reg_write_sequence(int reg, int val, uint8_t sequence[FSP_REG_SEQUENCE_BYTES])
+{
+    int register_value;
+    int register_select = fsp_mangle(reg, 0x55, 0x77, 0x74, &register_value);
+    
+    sequence[0] = 0xf3;
+    sequence[1] = register_select;
+    sequence[2] = register_value;
+    
+    register_select = fsp_mangle(val, 0x33, 0x44, 0x47, &register_value);
+    
+    sequence[3] = 0xf3;
+    sequence[4] = register_select;
+    sequence[5] = register_value;
+    return FSP_REG_SEQUENCE_BYTES;
+}
@@ -0,0 +1,419 @@
+//
+//  VoodooPS2SentelicFSPDecoder.h
+//
+//  Decoding of Sentelic FSP 4-byte packets (see fsp-lnxdrv-code/doc/fsp_packet.txt)
+//  and the byte sequences of the register access protocol.
+//
+//  Nothing in here depends on IOKit or the kernel, so the same code can be
+//  compiled and exercised in a user space program on any host.
+//
+
+#ifndef _VOODOOPS2SENTELICFSPDECODER_H
+#define _VOODOOPS2SENTELICFSPDECODER_H
+
+#include <stdint.h>
+
+/* Finger-sensing Pad packet formating related definitions */
+
+/* absolute packet type */
+#define	FSP_PKT_TYPE_NORMAL	(0x00)
+#define	FSP_PKT_TYPE_ABS	(0x01)
+#define	FSP_PKT_TYPE_NOTIFY	(0x02)
+#define	FSP_PKT_TYPE_NORMAL_OPC	(0x03)
+#define	FSP_PKT_TYPE_SHIFT	(6)
+
+#define FSP_CX_NOTIFY_MSG_TYPE_GUESTURE         0xba
+#define FSP_CX_NOTIFY_MSG_TYPE_ONE_FINGER_HOLD  0xC0
+#define FSP_CX_NOTIFY_MSG_TYPE_MFMC             0xb7
+
+//byte0
+#define MFMT_LEFT_BTN_DOWN  0x01
+#define MFMT_RIGHT_BTN_DOWN 0x02
+#define MFMT_FINGER_INDEX   0x04
+#define MFMT_PS2_SPECIFY    0x08
+#define MFMT_LEFT_BTN_OPC   0x10
+#define MFMT_COORD_MODE     0x20
+
+//byte3
+#define MFMT_SCROLL_RIGHT_BTN 0x80
+#define MFMT_SCROLL_LEFT_BTN  0x40
+#define MFMT_5TH_BTN          0x20
+#define MFMT_4TH_BTN          0x10
+
+#define MFMT_MID_BTN_DOWN   0x04
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// FSPPacket
+//
+// Result of decoding one packet.  Only the fields for the given type are set.
+//
+
+struct FSPPacket
+{
+    uint8_t type;           // FSP_PKT_TYPE_*
+    uint8_t buttons;        // bit 0 left, bit 1 right, bit 2 middle
+    
+    // FSP_PKT_TYPE_ABS
+    int     absX;           // 10-bit coordinates, 0/0 is finger up
+    int     absY;
+    uint8_t finger;         // finger index (MFMC mode)
+    bool    multiCoord;     // MFMC instead of SFAC packet
+    uint8_t extButtons;     // byte 4 bits 4-7 (4th/5th/scroll left/right)
+    
+    // FSP_PKT_TYPE_NORMAL, FSP_PKT_TYPE_NORMAL_OPC
+    int     dx;
+    int     dy;
+    
+    // FSP_PKT_TYPE_NOTIFY
+    uint8_t notifyType;     // FSP_CX_NOTIFY_MSG_TYPE_*
+    uint8_t gestureId;      // first parameter (gesture ID for 0xba)
+    uint8_t gestureValue;   // second parameter
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// FSPAssembler
+//
+// Collects the PS/2 byte stream into packets.  While waiting for byte 0,
+// bytes that cannot start a packet (0xfa, bit 3 clear) are dropped.  A
+// packet that fails fsp_packet_plausible is slid to the next byte that could
+// start one.  Every byte carries the caller's arrival time, so start always
+// belongs to the byte that is byte 0 after a slide.
+//
+
+#define FSP_PACKET_MAX      4
+
+enum FSPAssembleResult
+{
+    kFSPAssembleDropped = 0,    // byte thrown away while looking for byte 0
+    kFSPAssembleBuffering,
+    kFSPAssembleResync,         // lost the packet boundary, fragment slid
+    kFSPAssembleReady           // packet complete, start is its arrival
+};
+
+struct FSPAssembler
+{
+    int         count;          // bytes collected in the packet
+    uint64_t    times[FSP_PACKET_MAX];
+    uint64_t    start;          // arrival of byte 0
+    uint32_t    resyncs;        // lost packet boundaries
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// FSPFingerTracker
+//
+// Follows the Multi Finger, Multi Coordinate stream: a 0xb7 notify enters
+// MFMC mode, then abs packets for finger 0 and finger 1 arrive interleaved
+// (finger index in byte 0 bit 2) until a 0xb7 notify leaves it again.
+// A finger is up once it has reported 0/0; SFAC 0/0 means all fingers up.
+//
+
+#define FSP_MAX_FINGERS 2
+
+struct FSPFinger
+{
+    bool    down;
+    int     x, y;               // last position
+    int     dx, dy;             // movement since the previous packet of this finger
+};
+
+struct FSPFingerTracker
+{
+    bool      active;           // between MFMC enter and leave notifies
+    int       count;            // finger count from the enter notify
+    FSPFinger finger[FSP_MAX_FINGERS];
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// FSPAbsFilter
+//
+// Turns abs packets of one finger into relative motion.  Each axis runs a
+// FSP_ABS_AVERAGE sample moving average kept in FSP_SUBPIXEL_SHIFT fixed
+// point, and the fraction of each delta is carried over to the next packet,
+// so slow movements are neither lost nor stair-stepped.
+//
+
+#define FSP_SUBPIXEL_SHIFT  8
+#define FSP_ABS_AVERAGE     3
+
+struct FSPAbsAxis
+{
+    int     sample[FSP_ABS_AVERAGE];
+    int     count, index, sum;
+    int     last;               // averaged position of the previous packet, fixed point
+    int     rem;                // fraction of a count not yet returned
+};
+
+struct FSPAbsFilter
+{
+    bool        down;           // a packet of the current touch has been seen
+    FSPAbsAxis  x, y;
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// ScrollSmoother
+//
+// Turns the z deltas of 2 finger scroll notifies into scroll wheel deltas
+// (SCROLL_DELTA_FACTOR units) and the momentum that follows.  Times are in
+// whatever unit the caller uses for both filter() and setFlingInterval();
+// the driver passes absolute time.
+//
+
+template <class T, int N>
+class SimpleAverage2
+{
+private:
+    T m_buffer[N];
+    int m_count;
+    int m_sum;
+    int m_index;
+    int m_depth;    // entries in use, 1..N
+    
+public:
+    inline SimpleAverage2() { m_depth = N; reset(); }
+    inline void setDepth(int depth)
+    {
+        m_depth = depth < 1 ? 1 : depth > N ? N : depth;
+        reset();
+    }
+    T filter(T data)
+    {
+        // add new entry to sum
+        m_sum += data;
+        // if full buffer, then we are overwriting, so subtract old from sum
+        if (m_count == m_depth)
+            m_sum -= m_buffer[m_index];
+        // new entry into buffer
+        m_buffer[m_index] = data;
+        // move index to next position with wrap around
+        if (++m_index >= m_depth)
+            m_index = 0;
+        // keep count moving until buffer is full
+        if (m_count < m_depth)
+            ++m_count;
+        // return average of current items
+        return m_sum / m_count;
+    }
+    inline void reset()
+    {
+        m_count = 0;
+        m_sum = 0;
+        m_index = 0;
+    }
+    inline int count() { return m_count; }
+    inline int sum() { return m_sum; }
+    T oldest()
+    {
+        // undefined if nothing in here, return zero
+        if (m_count == 0)
+            return 0;
+        // if it is not full, oldest is at index 0
+        // if full, it is right where the next one goes
+        if (m_count < m_depth)
+            return m_buffer[0];
+        else
+            return m_buffer[m_index];
+    }
+    T newest()
+    {
+        // undefined if nothing in here, return zero
+        if (m_count == 0)
+            return 0;
+        // newest is index - 1, with wrap
+        int index = m_index;
+        if (--index < 0)
+            index = m_count-1;
+        return m_buffer[index];
+    }
+    T average()
+    {
+        if (m_count == 0)
+            return 0;
+        return m_sum / m_count;
+    }
+};
+
+
+// last N timestamps; unlike SimpleAverage2 there is no (int) sum to overflow
+template <int N>
+class TimeHistory
+{
+private:
+    uint64_t m_buffer[N];
+    int m_count;
+    int m_index;
+    int m_depth;    // entries in use, 1..N
+    
+public:
+    inline TimeHistory() { m_depth = N; reset(); }
+    inline void setDepth(int depth)
+    {
+        m_depth = depth < 1 ? 1 : depth > N ? N : depth;
+        reset();
+    }
+    inline void add(uint64_t time)
+    {
+        m_buffer[m_index] = time;
+        if (++m_index >= m_depth)
+            m_index = 0;
+        if (m_count < m_depth)
+            ++m_count;
+    }
+    inline void reset()
+    {
+        m_count = 0;
+        m_index = 0;
+    }
+    inline int count() { return m_count; }
+    inline uint64_t oldest()
+    {
+        if (m_count == 0)
+            return 0;
+        return m_count < m_depth ? m_buffer[0] : m_buffer[m_index];
+    }
+    inline uint64_t newest()
+    {
+        if (m_count == 0)
+            return 0;
+        return m_buffer[(m_index ? m_index : m_count) - 1];
+    }
+};
+
+
+#define SCROLL_DELTA_EVEN 0
+#define SCROLL_DELTA_INSCREASE 1
+#define SCROLL_DELTA_DESCREASE 2
+
+
+#define SCROLL_DELTA_FACTOR 32
+
+// fling decay per step (MomentumScrollMultiplier/MomentumScrollDivisor),
+// used whenever the configured ratio would not decay
+#define kFSPFlingMultiplier    60
+#define kFSPFlingDivisor       100
+
+// samples kept for the scroll velocity estimate (ScrollHistoryDepth)
+#define SCROLL_HISTORY_MAX 32
+
+class ScrollSmoother
+{
+private:
+    uint64_t lastinputTime;
+    uint64_t lastspeedCalcTime;
+    int  direction; //0 up, 1 down, 2 , left, 3 right
+    int  history[2];
+    int  lastDelta;
+    int  cur_history_index;
+    int  deltaDir; // 0- verage 1->increase  2- decress
+    int  inputCount;
+    int  stopDelta;
+    int  decDelta;
+    int  maxDelta;
+    SimpleAverage2<int, SCROLL_HISTORY_MAX> dz_history;
+    TimeHistory<SCROLL_HISTORY_MAX> time_history;   // arrival of each dz_history sample
+    uint64_t flingInterval;     // time between getFlingDelta calls, same unit as filter()
+    int  flingMultiplier;       // each fling tick: delta = delta*multiplier/divisor
+    int  flingDivisor;
+    int  flingThreshold;        // fling stops once delta is at or below this
+public:
+    ScrollSmoother();
+    ~ScrollSmoother();
+    void  setHistoryDepth(int depth);
+    void  setFlingInterval(uint64_t interval);
+    bool  setFlingDecay(int multiplier, int divisor, int threshold);
+    int   getSpeed();
+    int   getDelta();
+    int   getDir();
+    void  setDir(int dir);
+    int   filter(int dz, uint64_t now);
+    int   stop();
+    int   getFlingDelta();
+    bool  isFlinging();
+    
+};
+
+//
+// A 0xba notify carries the gesture ID in byte 2.  fsp_gesture_table maps
+// every ID to what the driver does with it, so a notify costs one lookup
+// instead of a walk through a switch.  IDs not listed are kFSPGestureIgnore.
+// Call fsp_gesture_table_init once before using the table.
+//
+
+#define FSP_GESTURE_PALM        0x38
+
+enum FSPGestureAction
+{
+    kFSPGestureIgnore = 0,
+    kFSPGestureScroll,          // arg is FSP_SCROLL_*
+    kFSPGestureMessage,         // arg is FSPGestureMessage, sent once per gesture
+    kFSPGestureAccumulate,      // same, sent each ZoomRotateThreshold of movement
+    kFSPGestureRightClick,
+    kFSPGestureEnd,
+    kFSPGesturePalm             // ignore packets until finger up
+};
+
+// scroll direction, the same values as the driver's SCROLL_DIR_*
+enum
+{
+    FSP_SCROLL_UP = 1,
+    FSP_SCROLL_DOWN,
+    FSP_SCROLL_LEFT,
+    FSP_SCROLL_RIGHT
+};
+
+// keyboard message to send, mapped to kPS2M_* by the driver
+enum FSPGestureMessage
+{
+    kFSPMessageSwipeDown = 0,
+    kFSPMessageSwipeUp,
+    kFSPMessageSwipeLeft,
+    kFSPMessageSwipeRight,
+    kFSPMessageZoomIn,
+    kFSPMessageZoomOut,
+    kFSPMessageRotateL,
+    kFSPMessageRotateR,
+    kFSPMessageLaunchPad,
+    kFSPMessageCount
+};
+
+struct FSPGestureEntry
+{
+    uint8_t action;             // FSPGestureAction
+    uint8_t arg;
+};
+
+extern FSPGestureEntry fsp_gesture_table[256];
+void fsp_gesture_table_init();
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Register access protocol
+//
+// A register read or write is a fixed sequence of bytes sent to the pad, each
+// acknowledged with 0xfa.  A read is followed by a Status Request (0xe9) whose
+// three reply bytes carry the value in the last one.  The sequence functions
+// fill in the bytes to send (with the value mangling the pad expects) and
+// return their number, so the driver and any host side model of the pad share
+// one definition of the protocol.
+//
+
+#define FSP_REG_SEQUENCE_BYTES      6
+
+// bytes on the wire for one whole operation, acks and reply included
+#define FSP_REG_READ_WIRE_BYTES     (FSP_REG_SEQUENCE_BYTES * 2 + 2 + 3)
+#define FSP_REG_WRITE_WIRE_BYTES    (FSP_REG_SEQUENCE_BYTES * 2)
+
+int fsp_reg_read_sequence(int reg, uint8_t sequence[FSP_REG_SEQUENCE_BYTES]);
+int fsp_reg_write_sequence(int reg, int val, uint8_t sequence[FSP_REG_SEQUENCE_BYTES]);
+
+void fsp_decode_packet(const uint8_t packet[4], FSPPacket* result);
+bool fsp_packet_plausible(const uint8_t packet[4]);
+void fsp_assembler_reset(FSPAssembler* assembler);
+int  fsp_assemble_byte(FSPAssembler* assembler, uint8_t packet[FSP_PACKET_MAX], int packetSize,
+                       uint8_t data, uint64_t time);
+void fsp_tracker_reset(FSPFingerTracker* tracker);
+bool fsp_tracker_update(FSPFingerTracker* tracker, const FSPPacket* packet);
+bool fsp_tracker_two_finger_motion(const FSPFingerTracker* tracker, int* dx, int* dy);
+void fsp_abs_reset(FSPAbsFilter* filter);
+bool fsp_abs_motion(FSPAbsFilter* filter, int absX, int absY, int* dx, int* dy);
+const char * fsp_get_guesture_name_by_id(int gestureId);
+
+#endif // _VOODOOPS2SENTELICFSPDECODER_H
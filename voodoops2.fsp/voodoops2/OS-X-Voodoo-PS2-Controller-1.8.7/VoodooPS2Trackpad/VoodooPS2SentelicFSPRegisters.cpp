@@ -0,0 +1,348 @@
+//
+//  VoodooPS2SentelicFSPRegisters.cpp
+//
+//  Sentelic FSP register access, identification and enable sequences.
+//
+
+#include "VoodooPS2SentelicFSPRegisters.h"
+
+//
+// Register access is encoded as a series of "set sample rate" style commands.
+// Values which collide with real sample rates (10/20/40/60/80/100/200) or
+// with reserved PS/2 commands (0xe9/0xee/0xf2/0xff) are mangled, and a
+// different selector byte tells the firmware how to undo it.
+//
+
+// Append one "transmit to mouse" byte to a request.  The ack is compared, so
+// a byte the pad did not take stops the request there instead of throwing
+// the rest of the sequence out of step.
+static int fsp_append_ps2_command(PS2Request * request, int i, int cmd)
+{
+    request->commands[i].command    = kPS2C_WriteCommandPort;
+    request->commands[i++].inOrOut  = kCP_TransmitToMouse;
+    request->commands[i].command    = kPS2C_WriteDataPort;
+    request->commands[i++].inOrOut  = cmd;
+    request->commands[i].command    = kPS2C_ReadDataPortAndCompare;
+    request->commands[i++].inOrOut  = kSC_Acknowledge;
+    return i;
+}
+
+// Append a register read; the register value ends up in commands[result-1].
+static int fsp_append_reg_read(PS2Request * request, int i, int reg)
+{
+    UInt8 sequence[FSP_REG_SEQUENCE_BYTES];
+    int count = fsp_reg_read_sequence(reg, sequence);
+
+    for (int j = 0; j < count; j++)
+        i = fsp_append_ps2_command(request, i, sequence[j]);
+
+    request->commands[i].command    = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[i++].inOrOut  = kDP_GetMouseInformation;
+    request->commands[i].command    = kPS2C_ReadDataPort;
+    request->commands[i++].inOrOut  = 0;
+    request->commands[i].command    = kPS2C_ReadDataPort;
+    request->commands[i++].inOrOut  = 0;
+    request->commands[i].command    = kPS2C_ReadDataPort;
+    request->commands[i++].inOrOut  = 0;
+    return i;
+}
+
+static int fsp_append_reg_write(PS2Request * request, int i, int reg, int val)
+{
+    UInt8 sequence[FSP_REG_SEQUENCE_BYTES];
+    int count = fsp_reg_write_sequence(reg, val, sequence);
+
+    for (int j = 0; j < count; j++)
+        i = fsp_append_ps2_command(request, i, sequence[j]);
+    return i;
+}
+
+//
+// Sends the rest of a request that stopped at command done.  A byte the pad
+// answered with kSC_Resend is sent again, as libps2 does, so the pad sees
+// the sequence it was in the middle of and not a new one; a failed
+// kPS2C_SendMouseCommandAndCompareAck (the 0xe9 of a read) is sent again
+// too.  Up to kFSPRegResends times, then the request stays failed.
+// Results are copied back to their place in the request.
+//
+
+static int fsp_resend(ApplePS2MouseDevice * device, PS2Request * request, int count, int done, UInt32 * bytes)
+{
+    TPS2Request<kFSPRegBatchCommands> tail;
+
+    for (int resends = 0; done < count && resends < kFSPRegResends; resends++)
+    {
+        PS2Command& failed = request->commands[done];
+        int from;
+        if (failed.command == kPS2C_ReadDataPortAndCompare && failed.inOrOut == kSC_Resend)
+        {
+            // from its kCP_TransmitToMouse
+            failed.inOrOut = kSC_Acknowledge;
+            from = done - 2;
+        }
+        else if (failed.command == kPS2C_SendMouseCommandAndCompareAck)
+            from = done;
+        else
+            break;
+
+        int n = count - from;
+        assert(n <= (int)countof(tail.commands));
+        memcpy(tail.commands, &request->commands[from], n * sizeof(PS2Command));
+        tail.commandsCount = n;
+        device->submitRequestAndBlock(&tail);
+        memcpy(&request->commands[from], tail.commands, n * sizeof(PS2Command));
+        done = from + tail.commandsCount;
+
+        // the byte and the pad's kSC_Resend
+        if (bytes)
+            *bytes += 2;
+    }
+    return done;
+}
+
+// Submits commands[0..count) of a request, resending as above.  Returns the
+// number of commands completed, which is also left in commandsCount.
+static int fsp_submit(ApplePS2MouseDevice * device, PS2Request * request, int count, UInt32 * bytes)
+{
+    request->commandsCount = count;
+    device->submitRequestAndBlock(request);
+    int done = request->commandsCount;
+    if (done < count)
+        done = fsp_resend(device, request, count, done, bytes);
+    request->commandsCount = done;
+    return done;
+}
+
+int fsp_reg_read(ApplePS2MouseDevice * device, PS2Request * request, int reg)
+{
+    // whole read sequence goes down in a single request (kFSPRegReadCommands)
+    int count = fsp_append_reg_read(request, 0, reg);
+    fsp_submit(device, request, count, NULL);
+
+  //  IOLog("ApplePS2Trackpad: Sentelic FSP: fsp_reg_read(reg = %0x) => %0x\n", reg, request->commands[count-1].inOrOut);
+
+    return (request->commandsCount == count) ? request->commands[count-1].inOrOut : -1;
+}
+
+//
+// Execute a list of register reads/writes with as few requests as possible.
+// Each request holds as many whole operations as fit in kFSPRegBatchCommands,
+// so the command gate is crossed once per chunk instead of once per byte.
+//
+// On return ops[i].result holds the value read (reads), the value written
+// (writes), or -1 if the operation was not completed.  The return value is
+// the number of completed operations.  If elapsed_ns is non-NULL it receives
+// the total time spent in the batch.  If bytes is non-NULL the PS/2 bytes
+// exchanged by the completed operations, and by any resends, are added to it.
+//
+
+int fsp_reg_batch(ApplePS2MouseDevice * device, FSPRegOp ops[], int count, uint64_t * elapsed_ns, UInt32 * bytes)
+{
+    TPS2Request<kFSPRegBatchCommands> request;
+    uint64_t start_abs, end_abs;
+    int done = 0;
+
+    clock_get_uptime(&start_abs);
+
+    for (int i = 0; i < count; i++)
+        ops[i].result = -1;
+
+    while (done < count)
+    {
+        // fill request with as many complete operations as will fit
+        int ends[kFSPRegBatchCommands / kFSPRegWriteCommands];
+        int n = 0, index = 0;
+        while (done + n < count && n < (int)countof(ends))
+        {
+            FSPRegOp& op = ops[done + n];
+            int needed = op.write ? kFSPRegWriteCommands : kFSPRegReadCommands;
+            if (index + needed > kFSPRegBatchCommands)
+                break;
+            if (op.write)
+                index = fsp_append_reg_write(&request, index, op.reg, op.value);
+            else
+                index = fsp_append_reg_read(&request, index, op.reg);
+            ends[n++] = index;
+        }
+        assert(index <= (int)countof(request.commands));
+        fsp_submit(device, &request, index, bytes);
+
+        // commandsCount is the index of the failed command (if any)
+        int completed = 0;
+        for (int j = 0; j < n && ends[j] <= request.commandsCount; j++, completed++)
+        {
+            FSPRegOp& op = ops[done + j];
+            op.result = op.write ? op.value : request.commands[ends[j]-1].inOrOut;
+            if (bytes)
+                *bytes += op.write ? FSP_REG_WRITE_WIRE_BYTES : FSP_REG_READ_WIRE_BYTES;
+        }
+        done += completed;
+        if (completed != n)
+            break;
+    }
+
+    clock_get_uptime(&end_abs);
+    uint64_t ns;
+    absolutetime_to_nanoseconds(end_abs - start_abs, &ns);
+    if (elapsed_ns)
+        *elapsed_ns = ns;
+
+    DEBUG_LOG("ApplePS2Trackpad: Sentelic FSP: fsp_reg_batch(%d) completed %d in %lld us\n", count, done, ns / 1000);
+
+    return done;
+}
+
+// buttons the pad has, from FSP_REG_TMOD_STATUS1
+int fsp_buttons_from_tmod(int val)
+{
+	static const int buttons[] = {
+		0x16, /* Left/Middle/Right/Forward/Backward & Scroll Up/Down */
+		0x06, /* Left/Middle/Right & Scroll Up/Down/Right/Left */
+		0x04, /* Left/Middle/Right & Scroll Up/Down */
+		0x02, /* Left/Middle/Right */
+	};
+    
+	if (val== -1)
+		return -1;
+    
+	return buttons[(val & 0x30) >> 4];
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Enables on-pad click tagging, turns off the icon/MSID packets and writes
+// SWREG1 (what the old fsp_opctag_enable(true), fsp_onpad_icon(false) and
+// fsp_reg_write sequence did), pipelined: one request for the three reads,
+// one for all writes plus a SWREG1 readback to verify them.
+// The PS/2 bytes exchanged are added to *bytes.
+//
+
+bool fsp_setup_registers(ApplePS2MouseDevice * device, int swreg1, UInt32 * bytes)
+{
+    FSPRegOp reads[] =
+    {
+        { FSP_REG_SYSCTL1 },
+        { FSP_REG_OPC_QDOWN },
+        { FSP_REG_SYSCTL5 },
+    };
+    if (fsp_reg_batch(device, reads, countof(reads), NULL, bytes) != countof(reads))
+        return false;
+    
+    int sysctl1 = reads[0].result, opc = reads[1].result, sysctl5 = reads[2].result;
+    sysctl5 &= ~(FSP_BIT_EN_MSID7 | FSP_BIT_EN_MSID8 | FSP_BIT_EN_AUTO_MSID8);
+    
+    FSPRegOp ops[] =
+    {
+        { FSP_REG_SYSCTL1,   true,  (UInt8)(sysctl1 | FSP_BIT_EN_REG_CLK) },
+        { FSP_REG_OPC_QDOWN, true,  (UInt8)(opc | FSP_BIT_EN_OPC_TAG) },
+        { FSP_REG_SYSCTL1,   true,  (UInt8)(sysctl1 & ~FSP_BIT_EN_REG_CLK) },
+        { FSP_REG_SYSCTL5,   true,  (UInt8)sysctl5 },
+        { FSP_REG_SWREG1,    true,  (UInt8)swreg1 },
+        { FSP_REG_SWREG1,    false },
+    };
+    int done = fsp_reg_batch(device, ops, countof(ops), NULL, bytes);
+    return done == countof(ops) && ops[countof(ops)-1].result == swreg1;
+}
+
+
+int fsp_intellimouse_mode(ApplePS2MouseDevice * device, PS2Request * request)
+{
+    request->commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[0].inOrOut = kDP_SetMouseSampleRate;
+    request->commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[1].inOrOut = 200;
+
+    request->commands[2].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[2].inOrOut = kDP_SetMouseSampleRate;
+    request->commands[3].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[3].inOrOut = 200;
+
+    request->commands[4].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[4].inOrOut = kDP_SetMouseSampleRate;
+    request->commands[5].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[5].inOrOut = 80;
+
+    request->commands[6].command = kPS2C_SendMouseCommandAndCompareAck;
+    request->commands[6].inOrOut = kDP_GetId;
+    request->commands[7].command = kPS2C_ReadDataPort;
+    request->commands[7].inOrOut = 0;
+
+    fsp_submit(device, request, 8, NULL);
+
+    IOLog("ApplePS2Trackpad: Sentelic FSP: fsp_intellimouse_mode() => %0x\n", request->commands[7].inOrOut);
+
+    return request->commands[7].inOrOut;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Any other mouse gets just the one register read; the rest of the
+// identification registers go out in one PS/2 request once the ID matches.
+//
+
+bool fsp_identify(ApplePS2MouseDevice * device, UInt16 * version, UInt8 * buttons)
+{
+    FSPRegOp id[] = { { FSP_REG_DEVICE_ID } };
+    FSPRegOp ops[] =
+    {
+        { FSP_REG_VERSION },
+        { FSP_REG_REVISION },
+        { FSP_REG_TMOD_STATUS1 },
+    };
+    if (fsp_reg_batch(device, id, countof(id), NULL) != countof(id) ||
+        id[0].result != FSP_DEVICE_MAGIC ||
+        fsp_reg_batch(device, ops, countof(ops), NULL) != countof(ops))
+        return false;
+    
+    *version = (ops[0].result << 8) | ops[1].result;
+    *buttons = fsp_buttons_from_tmod(ops[2].result);
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Starts or stops the reporting of data packets.  Enabling also writes the
+// registers (retried once from fresh reads), switches to 4 byte packets if
+// the pad takes the intellimouse sequence, and sets samplerate (0 keeps the
+// 80 the sequence left).  *packetSize is only changed to 4.
+//
+// Returns false if the register setup could not be verified.  The PS/2
+// bytes exchanged by the register setup are added to *bytes.
+//
+
+bool fsp_set_enable(ApplePS2MouseDevice * device, bool enable, int swreg1, int samplerate,
+                    UInt8 * packetSize, UInt32 * bytes)
+{
+    TPS2Request<> request;
+    
+    // (mouse enable/disable command)
+    request.commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+    request.commands[0].inOrOut =  enable ? kDP_Enable : kDP_SetDefaultsAndDisable;
+    fsp_submit(device, &request, 1, NULL);
+    
+    if (!enable)
+        return true;
+    
+    // enable one-pad-click tagging, so we can filter them out!
+    bool verified = fsp_setup_registers(device, swreg1, bytes);
+    if (!verified)
+    {
+        // something was NAKed, start over from fresh reads
+        verified = fsp_setup_registers(device, swreg1, bytes);
+    }
+    if (!verified)
+        IOLog("ApplePS2Trackpad: Sentelic FSP: register setup failed, pad may be half configured\n");
+    
+    // turn on intellimouse mode (4 bytes per packet)
+    if (fsp_intellimouse_mode(device, &request) == 4)
+        *packetSize = 4;
+    
+    // the intellimouse sequence left the rate at 80, switch to the configured one
+    if (samplerate)
+    {
+        request.commands[0].command = kPS2C_SendMouseCommandAndCompareAck;
+        request.commands[0].inOrOut = kDP_SetMouseSampleRate;
+        request.commands[1].command = kPS2C_SendMouseCommandAndCompareAck;
+        request.commands[1].inOrOut = samplerate;
+        if (fsp_submit(device, &request, 2, NULL) != 2)
+            IOLog("ApplePS2Trackpad: Sentelic FSP: sample rate %d not accepted\n", samplerate);
+    }
+    return verified;
+}
@@ -0,0 +1,101 @@
+//
+//  VoodooPS2SentelicFSPRegisters.h
+//
+//  Sentelic FSP register access, identification and enable sequences, as
+//  PS/2 requests submitted to an ApplePS2MouseDevice.
+//
+//  Only ApplePS2MouseDevice::submitRequestAndBlock and the PS2Request types
+//  are used, so the host tools build this file unchanged against a stand-in
+//  ApplePS2MouseDevice.h (tools/host) that runs the requests on a simulated
+//  pad.
+//
+
+#ifndef _VOODOOPS2SENTELICFSPREGISTERS_H
+#define _VOODOOPS2SENTELICFSPREGISTERS_H
+
+#include "ApplePS2MouseDevice.h"
+#include "VoodooPS2SentelicFSPDecoder.h"
+
+/* Finger-sensing Pad information registers */
+#define	FSP_REG_DEVICE_ID	0x00
+#define	FSP_REG_VERSION		0x01
+#define	FSP_REG_REVISION	0x04
+#define	FSP_REG_TMOD_STATUS1	0x0B
+#define	FSP_BIT_NO_ROTATION	0x08
+#define	FSP_REG_PAGE_CTRL	0x0F
+
+/* Finger-sensing Pad control registers */
+#define	FSP_REG_SYSCTL1		0x10
+#define	FSP_BIT_EN_REG_CLK	0x20
+#define	FSP_REG_OPC_QDOWN	0x31
+#define	FSP_BIT_EN_OPC_TAG	0x80
+#define	FSP_REG_OPTZ_XLO	0x34
+#define	FSP_REG_OPTZ_XHI	0x35
+#define	FSP_REG_OPTZ_YLO	0x36
+#define	FSP_REG_OPTZ_YHI	0x37
+#define	FSP_REG_SYSCTL5		0x40
+#define	FSP_REG_SWREG1		0x90
+
+
+#define	FSP_BIT_90_DEGREE	0x01
+#define	FSP_BIT_EN_MSID6	0x02
+#define	FSP_BIT_EN_MSID7	0x04
+#define	FSP_BIT_EN_MSID8	0x08
+#define	FSP_BIT_EN_AUTO_MSID8	0x20
+#define	FSP_BIT_EN_PKT_G0	0x40
+
+#define	FSP_REG_ONPAD_CTL	0x43
+#define	FSP_BIT_ONPAD_ENABLE	0x01
+#define	FSP_BIT_ONPAD_FBBB	0x02
+#define	FSP_BIT_FIX_VSCR	0x03
+#define	FSP_BIT_FIX_HSCR	0x20
+#define	FSP_BIT_DRAG_LOCK	0x40
+
+
+#define FSP_DEVICE_MAGIC		0x01
+
+
+/* swreg1 values, supported in Cx hardware */
+#define FSP_CX_ABSOLUTE_MODE     0x01
+#define FSP_CX_GESTURE_OUTPUT	0x02
+#define FSP_CX_2FINGERS_OUTPUT	0x04
+#define FSP_CX_FINGER_UP_OUTPUT	0x08
+#define FSP_CX_CONTINUOUS_MODE	0x10
+#define FSP_CX_GUEST_GROUP_BIT1  0x20
+#define FSP_CX_GUEST_GROUP_BIT2  0x40
+#define FSP_CX_COMPATIBLE_MODE   0x80
+
+// SWREG1 written on enable: absolute MFMC packets with gestures and finger up
+#define kFSPEnableSwreg1          (FSP_CX_ABSOLUTE_MODE | FSP_CX_GESTURE_OUTPUT | \
+                                   FSP_CX_2FINGERS_OUTPUT | FSP_CX_FINGER_UP_OUTPUT | \
+                                   FSP_CX_CONTINUOUS_MODE | FSP_CX_GUEST_GROUP_BIT1 | \
+                                   FSP_CX_GUEST_GROUP_BIT2)
+
+// number of PS/2 commands needed for a single FSP register access
+#define kFSPRegReadCommands       22
+#define kFSPRegWriteCommands      18
+// max commands sent in one request by fsp_reg_batch (UInt8 commandsCount)
+#define kFSPRegBatchCommands      (kFSPRegReadCommands*6)
+// bytes sent again per request when the pad answers kSC_Resend
+#define kFSPRegResends            2
+
+// one entry in a batched register transaction (see fsp_reg_batch)
+struct FSPRegOp
+{
+    UInt8   reg;
+    bool    write;
+    UInt8   value;      // value to write (write only)
+    int     result;     // value read/written, -1 if not completed
+};
+
+int  fsp_reg_read(ApplePS2MouseDevice * device, PS2Request * request, int reg);
+int  fsp_reg_batch(ApplePS2MouseDevice * device, FSPRegOp ops[], int count, uint64_t * elapsed_ns,
+                   UInt32 * bytes = NULL);
+int  fsp_buttons_from_tmod(int val);
+bool fsp_setup_registers(ApplePS2MouseDevice * device, int swreg1, UInt32 * bytes);
+int  fsp_intellimouse_mode(ApplePS2MouseDevice * device, PS2Request * request);
+bool fsp_identify(ApplePS2MouseDevice * device, UInt16 * version, UInt8 * buttons);
+bool fsp_set_enable(ApplePS2MouseDevice * device, bool enable, int swreg1, int samplerate,
+                    UInt8 * packetSize, UInt32 * bytes);
+
+#endif // _VOODOOPS2SENTELICFSPREGISTERS_H
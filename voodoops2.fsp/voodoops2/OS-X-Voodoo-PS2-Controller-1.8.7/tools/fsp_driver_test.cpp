@@ -0,0 +1,346 @@
+//
+//  fsp_driver_test.cpp
+//
+//  Runs the driver's own PS/2 code (VoodooPS2SentelicFSPRegisters.cpp, built
+//  against host/ApplePS2MouseDevice.h) against the simulated pad in fsp_sim:
+//
+//    registers   fsp_reg_read and fsp_reg_batch reads and writes, chunked
+//                into requests, with the bytes they report against the bytes
+//                the pad saw
+//    identify    what probe does, on an FSP and on a pad that is not one
+//    enable      what setTouchPadEnable does: the register setup and its
+//                readback, 4 byte packets, the sample rate, and disable
+//    NAK         enable with the pad missing each byte of the sequence in
+//                turn, once (sent again, nothing else changes) and for good
+//                (a verified setup must really be on the pad)
+//    packets     scripted touches and gestures from the enabled pad through
+//                fsp_assemble_byte, fsp_decode_packet and fsp_tracker_update
+//                with the packet size enable left, as interruptOccurred and
+//                packetReady feed them
+//
+
+#include "ApplePS2MouseDevice.h"
+#include "VoodooPS2SentelicFSPRegisters.h"
+
+#include <stdio.h>
+#include <vector>
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { if (!(cond)) { ++failures; printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); } } while (0)
+
+#define VERSION     0xe1
+#define REVISION    0x05
+#define TMOD        0x20        // buttons 0x04
+#define SYSCTL5     0xff        // every MSID bit set
+
+static void new_pad(FSPSim* sim)
+{
+    fsp_sim_init(sim, VERSION, REVISION, TMOD);
+    sim->regs[0][FSP_REG_SYSCTL5] = SYSCTL5;
+}
+
+static uint32_t traffic(const FSPSim* sim)
+{
+    return sim->bytesIn + sim->bytesOut;
+}
+
+// what fsp_setup_registers leaves on the pad for swreg1
+static bool pad_configured(const FSPSim* sim, int swreg1)
+{
+    return sim->regs[0][FSP_REG_SWREG1] == swreg1 &&
+           (sim->regs[0][FSP_REG_OPC_QDOWN] & FSP_BIT_EN_OPC_TAG) &&
+           !(sim->regs[0][FSP_REG_SYSCTL1] & FSP_BIT_EN_REG_CLK) &&
+           sim->regs[0][FSP_REG_SYSCTL5] == (SYSCTL5 & ~(FSP_BIT_EN_MSID7 | FSP_BIT_EN_MSID8 | FSP_BIT_EN_AUTO_MSID8));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void test_registers()
+{
+    FSPSim sim;
+    new_pad(&sim);
+    ApplePS2MouseDevice device(&sim);
+
+    // waitForDeviceReady's request holds exactly one read
+    TPS2Request<kFSPRegReadCommands> request;
+    CHECK(fsp_reg_read(&device, &request, FSP_REG_DEVICE_ID) == FSP_DEVICE_MAGIC, "device ID");
+    CHECK(request.commandsCount == kFSPRegReadCommands, "read took %d commands", request.commandsCount);
+    CHECK(fsp_reg_read(&device, &request, FSP_REG_VERSION) == VERSION, "version");
+
+    // enough operations for several requests
+    std::vector<FSPRegOp> ops;
+    for (int reg = 0x20; reg < 0x30; reg++)
+    {
+        FSPRegOp write = { (UInt8)reg, true, (UInt8)(reg * 7) };
+        ops.push_back(write);
+    }
+    for (int reg = 0x20; reg < 0x30; reg++)
+    {
+        FSPRegOp read = { (UInt8)reg };
+        ops.push_back(read);
+    }
+    UInt32 bytes = 0;
+    uint32_t before = traffic(&sim);
+    int requests = device.requests;
+    int done = fsp_reg_batch(&device, &ops[0], (int)ops.size(), NULL, &bytes);
+    CHECK(done == (int)ops.size(), "batch completed %d of %zu", done, ops.size());
+    for (int reg = 0x20; reg < 0x30; reg++)
+        CHECK(ops[reg - 0x20 + 16].result == ((reg * 7) & 0xff), "reg %02x read %02x", reg, ops[reg - 0x20 + 16].result);
+    CHECK(bytes == traffic(&sim) - before, "batch reported %u bytes, pad saw %u", bytes, traffic(&sim) - before);
+    // 16 writes of kFSPRegWriteCommands and 16 reads of kFSPRegReadCommands
+    int commands = 16 * kFSPRegWriteCommands + 16 * kFSPRegReadCommands;
+    int least = (commands + kFSPRegBatchCommands - 1) / kFSPRegBatchCommands;
+    CHECK(device.requests - requests >= least && device.requests - requests <= least + 1,
+          "batch took %d requests", device.requests - requests);
+    CHECK(sim.protocolErrors == 0 && device.failed == 0 && device.timeouts == 0,
+          "%u protocol errors, %d failed requests, %d timeouts", sim.protocolErrors, device.failed, device.timeouts);
+
+    // a byte the pad asks for again is sent again, every byte of a read
+    FSPRegOp reads[] = { { FSP_REG_VERSION }, { FSP_REG_REVISION }, { FSP_REG_TMOD_STATUS1 } };
+    for (int i = 1; i <= FSP_REG_SEQUENCE_BYTES + 1; i++)
+    {
+        // byte i of the second read
+        device.nakAt = device.sent + FSP_REG_SEQUENCE_BYTES + 1 + i;
+        bytes = 0;
+        before = traffic(&sim);
+        done = fsp_reg_batch(&device, reads, countof(reads), NULL, &bytes);
+        CHECK(done == 3 && reads[0].result == VERSION && reads[1].result == REVISION && reads[2].result == TMOD,
+              "NAK of byte %d: batch completed %d, read %02x", i, done, reads[1].result);
+        CHECK(bytes == traffic(&sim) - before, "NAK of byte %d: batch reported %u bytes, pad saw %u",
+              i, bytes, traffic(&sim) - before);
+    }
+
+    // one that never takes it stops the batch there
+    device.nakAt = device.sent + FSP_REG_SEQUENCE_BYTES + 1 + 1;
+    device.naks = kFSPRegResends + 1;
+    done = fsp_reg_batch(&device, reads, countof(reads), NULL);
+    CHECK(done == 1 && reads[0].result == VERSION && reads[1].result == -1 && reads[2].result == -1,
+          "NAKed batch completed %d", done);
+    CHECK(sim.protocolErrors == 0, "%u protocol errors", sim.protocolErrors);
+}
+
+static void test_identify()
+{
+    FSPSim sim;
+    new_pad(&sim);
+    ApplePS2MouseDevice device(&sim);
+    UInt16 version = 0;
+    UInt8 buttons = 0;
+    CHECK(fsp_identify(&device, &version, &buttons), "FSP not identified");
+    CHECK(version == ((VERSION << 8) | REVISION), "version %04x", version);
+    CHECK(buttons == 0x04, "buttons %02x", buttons);
+    CHECK(device.requests == 2, "identify took %d requests", device.requests);
+    CHECK(sim.protocolErrors == 0, "%u protocol errors", sim.protocolErrors);
+
+    // anything else gets the one register read
+    FSPSim other;
+    new_pad(&other);
+    for (int page = 0; page < FSP_SIM_PAGES; page++)
+        other.regs[page][FSP_REG_DEVICE_ID] = 0x00;
+    ApplePS2MouseDevice mouse(&other);
+    CHECK(!fsp_identify(&mouse, &version, &buttons), "other pad identified");
+    CHECK(mouse.requests == 1, "identify of other pad took %d requests", mouse.requests);
+}
+
+static void test_enable()
+{
+    FSPSim sim;
+    new_pad(&sim);
+    ApplePS2MouseDevice device(&sim);
+    UInt8 packetSize = 3;
+    UInt32 bytes = 0;
+    uint32_t before = traffic(&sim);
+    CHECK(fsp_set_enable(&device, true, kFSPEnableSwreg1, 100, &packetSize, &bytes), "setup not verified");
+    CHECK(pad_configured(&sim, kFSPEnableSwreg1), "pad registers");
+    CHECK(sim.enabled, "pad not reporting");
+    CHECK(packetSize == 4 && sim.id == 4, "packet size %d, pad ID %d", packetSize, sim.id);
+    CHECK(sim.rate == 100, "sample rate %d", sim.rate);
+    // 3 reads, then 5 writes and a readback
+    CHECK(bytes == 4 * FSP_REG_READ_WIRE_BYTES + 5 * FSP_REG_WRITE_WIRE_BYTES, "register bytes %u", bytes);
+    CHECK(bytes < traffic(&sim) - before, "register bytes %u of %u", bytes, traffic(&sim) - before);
+    CHECK(sim.protocolErrors == 0 && device.failed == 0, "%u protocol errors, %d failed requests",
+          sim.protocolErrors, device.failed);
+
+    CHECK(fsp_set_enable(&device, false, kFSPEnableSwreg1, 100, &packetSize, &bytes), "disable");
+    CHECK(!sim.enabled, "pad still reporting");
+
+    // samplerate 0 keeps the 80 of the intellimouse sequence
+    FSPSim pad;
+    new_pad(&pad);
+    ApplePS2MouseDevice other(&pad);
+    packetSize = 3;
+    fsp_set_enable(&other, true, kFSPEnableSwreg1, 0, &packetSize, &bytes);
+    CHECK(pad.rate == 80, "sample rate %d", pad.rate);
+}
+
+static void test_enable_nak()
+{
+    // the bytes one clean enable sends
+    FSPSim sim;
+    new_pad(&sim);
+    ApplePS2MouseDevice clean(&sim);
+    UInt8 packetSize = 3;
+    UInt32 bytes = 0;
+    fsp_set_enable(&clean, true, kFSPEnableSwreg1, 100, &packetSize, &bytes);
+    int total = clean.sent;
+
+    // a byte the pad misses once is sent again and nothing else changes
+    for (int nak = 1; nak <= total; nak++)
+    {
+        new_pad(&sim);
+        ApplePS2MouseDevice device(&sim);
+        device.nakAt = nak;
+        packetSize = 3;
+        bool ok = fsp_set_enable(&device, true, kFSPEnableSwreg1, 100, &packetSize, &bytes);
+        CHECK(ok && pad_configured(&sim, kFSPEnableSwreg1), "NAK of byte %d: setup %s", nak, ok ? "wrong" : "failed");
+        CHECK(sim.enabled && packetSize == 4 && sim.rate == 100, "NAK of byte %d: enabled %d, packet size %d, rate %d",
+              nak, sim.enabled, packetSize, sim.rate);
+        CHECK(device.sent == total + 1, "NAK of byte %d: %d bytes sent, not %d", nak, device.sent, total + 1);
+        CHECK(sim.protocolErrors == 0, "NAK of byte %d: %u protocol errors", nak, sim.protocolErrors);
+    }
+
+    // one it never takes fails the request; a setup that says it is verified
+    // must be on the pad, and 4 byte packets must come from a pad in that mode
+    int verified = 0;
+    for (int nak = 1; nak <= total; nak++)
+    {
+        new_pad(&sim);
+        ApplePS2MouseDevice device(&sim);
+        device.nakAt = nak;
+        device.naks = kFSPRegResends + 1;
+        packetSize = 3;
+        bool ok = fsp_set_enable(&device, true, kFSPEnableSwreg1, 100, &packetSize, &bytes);
+        if (ok)
+            ++verified;
+        CHECK(!ok || pad_configured(&sim, kFSPEnableSwreg1), "lost byte %d: verified but not configured", nak);
+        CHECK(packetSize != 4 || sim.id == 4, "lost byte %d: 4 byte packets from a pad with ID %d", nak, sim.id);
+    }
+    printf("enable: %d bytes; each missed once recovered, each lost: %d verified\n", total, verified);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+// one packet off the pad through the byte path; false if none came out
+static bool receive(FSPSim* sim, FSPAssembler* assembler, int packetSize, const FSPSimEvent& event,
+                    FSPPacket* fsp, int* sent)
+{
+    uint8_t bytes[4], packet[FSP_PACKET_MAX];
+    *sent = fsp_sim_packet(sim, &event, bytes);
+    bool ready = false;
+    for (int i = 0; i < *sent; i++)
+        if (fsp_assemble_byte(assembler, packet, packetSize, bytes[i], i) == kFSPAssembleReady)
+            ready = true;
+    if (ready)
+        fsp_decode_packet(packet, fsp);
+    return ready;
+}
+
+static void test_packets()
+{
+    FSPSim sim;
+    new_pad(&sim);
+    ApplePS2MouseDevice device(&sim);
+    FSPAssembler assembler = {};
+    FSPFingerTracker tracker;
+    fsp_tracker_reset(&tracker);
+    FSPPacket fsp;
+    int sent;
+
+    FSPSimEvent touch = { kFSPSimTouch, 400, 300 };
+    CHECK(!receive(&sim, &assembler, 3, touch, &fsp, &sent) && sent == 0, "packet before enable");
+
+    UInt8 packetSize = 3;
+    UInt32 bytes = 0;
+    fsp_set_enable(&device, true, kFSPEnableSwreg1, 100, &packetSize, &bytes);
+
+    // one finger drag, then lift
+    for (int i = 0; i < 50; i++)
+    {
+        FSPSimEvent event = { kFSPSimTouch, 100 + i * 13, 700 - i * 9 };
+        CHECK(receive(&sim, &assembler, packetSize, event, &fsp, &sent), "drag packet %d lost", i);
+        CHECK(fsp.type == FSP_PKT_TYPE_ABS && !fsp.multiCoord && fsp.absX == event.x && fsp.absY == event.y,
+              "drag packet %d: type %d at %d/%d", i, fsp.type, fsp.absX, fsp.absY);
+    }
+    FSPSimEvent lift = { kFSPSimLift };
+    CHECK(receive(&sim, &assembler, packetSize, lift, &fsp, &sent), "finger up lost");
+    CHECK(fsp.type == FSP_PKT_TYPE_ABS && fsp.absX == 0 && fsp.absY == 0, "finger up at %d/%d", fsp.absX, fsp.absY);
+
+    // a two finger MFMC run
+    FSPSimEvent enter = { kFSPSimFingers, 0, 0, 0, 0, 2 };
+    CHECK(receive(&sim, &assembler, packetSize, enter, &fsp, &sent), "MFMC enter lost");
+    fsp_tracker_update(&tracker, &fsp);
+    CHECK(tracker.active && tracker.count == 2, "tracker not in MFMC mode");
+    for (int i = 0; i < 20; i++)
+    {
+        for (int f = 0; f < 2; f++)
+        {
+            FSPSimEvent event = { kFSPSimTouch2, 300 + f * 200 + i * 4, 400 + i * 6, (uint8_t)f };
+            CHECK(receive(&sim, &assembler, packetSize, event, &fsp, &sent), "MFMC packet %d/%d lost", i, f);
+            fsp_tracker_update(&tracker, &fsp);
+            CHECK(tracker.finger[f].down && tracker.finger[f].x == event.x && tracker.finger[f].y == event.y,
+                  "finger %d at %d/%d, sent %d/%d", f, tracker.finger[f].x, tracker.finger[f].y, event.x, event.y);
+        }
+    }
+    int dx, dy;
+    CHECK(fsp_tracker_two_finger_motion(&tracker, &dx, &dy) && dx == 4 && dy == 6, "two finger motion %d/%d", dx, dy);
+    FSPSimEvent leave = { kFSPSimFingers };
+    receive(&sim, &assembler, packetSize, leave, &fsp, &sent);
+    fsp_tracker_update(&tracker, &fsp);
+    CHECK(!tracker.active, "tracker still in MFMC mode");
+
+    // gesture notifies come out with their ID and value
+    static const uint8_t ids[] = { 0x82, 0x86, 0x2e, 0x8f, 0x2f };
+    for (unsigned i = 0; i < countof(ids); i++)
+    {
+        FSPSimEvent event = { kFSPSimGesture, 0, 0, 0, ids[i], (uint8_t)(i * 3) };
+        CHECK(receive(&sim, &assembler, packetSize, event, &fsp, &sent), "gesture %02x lost", ids[i]);
+        CHECK(fsp.type == FSP_PKT_TYPE_NOTIFY && fsp.notifyType == FSP_CX_NOTIFY_MSG_TYPE_GUESTURE &&
+              fsp.gestureId == ids[i] && fsp.gestureValue == i * 3, "gesture %02x came out as %02x", ids[i], fsp.gestureId);
+    }
+    CHECK(assembler.resyncs == 0, "%u resyncs", assembler.resyncs);
+
+    // disabled, the pad sends nothing
+    fsp_set_enable(&device, false, kFSPEnableSwreg1, 100, &packetSize, &bytes);
+    CHECK(!receive(&sim, &assembler, packetSize, touch, &fsp, &sent) && sent == 0, "packet after disable");
+
+    // SWREG1 0: relative packets, finger up and gestures not reported
+    FSPSim rel;
+    new_pad(&rel);
+    ApplePS2MouseDevice relDevice(&rel);
+    packetSize = 3;
+    fsp_set_enable(&relDevice, true, 0, 100, &packetSize, &bytes);
+    int x = 0, y = 0;
+    for (int i = 1; i <= 30; i++)
+    {
+        FSPSimEvent event = { kFSPSimTouch, i * 11, i * 7 };
+        CHECK(receive(&rel, &assembler, packetSize, event, &fsp, &sent), "relative packet %d lost", i);
+        CHECK(fsp.type == FSP_PKT_TYPE_NORMAL && sent == packetSize, "relative packet %d: type %d, %d bytes",
+              i, fsp.type, sent);
+        x += fsp.dx;
+        y += fsp.dy;
+    }
+    CHECK(x == 30 * 11 && y == 30 * 7, "relative motion %d/%d", x, y);
+    uint8_t packet[4];
+    CHECK(fsp_sim_packet(&rel, &lift, packet) == 0, "finger up in relative mode");
+    CHECK(assembler.resyncs == 0, "%u resyncs", assembler.resyncs);
+}
+
+int main()
+{
+    // the driver logs every enable
+    ApplePS2MouseDevice::log = false;
+    test_registers();
+    test_identify();
+    test_enable();
+    test_enable_nak();
+    test_packets();
+    if (failures)
+    {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("fsp_driver_test passed\n");
+    return 0;
+}
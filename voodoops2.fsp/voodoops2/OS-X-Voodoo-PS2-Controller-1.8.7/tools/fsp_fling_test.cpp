@@ -0,0 +1,204 @@
+//
+//  fsp_fling_test.cpp
+//
+//  Checks that ScrollSmoother::getFlingDelta, now integer only, gives the
+//  same steps every time:
+//
+//    golden      a flick with the default 60/100 decay gives a fixed list
+//                of steps, the same on every host and every build
+//    repeat      the same flick, on fresh smoothers and on one reused
+//                smoother, gives the same steps every time
+//    recurrence  for every start delta up to 64k and a range of decay
+//                ratios and thresholds, the steps are
+//                delta*multiplier/divisor, stop at the threshold and never
+//                number more than the start delta
+//    config      ratios that would not decay are refused and replaced by
+//                kFSPFlingMultiplier/kFSPFlingDivisor
+//
+//  usage: fsp_fling_test
+//
+
+#include "VoodooPS2SentelicFSPDecoder.h"
+
+#include <stdio.h>
+#include <vector>
+
+#define PACKET_NS       12500000ULL     // 80 packets/sec
+#define FLING_NS        20000000ULL     // momentumscrollInteval
+#define FLICK_NOTIFIES  6
+#define FLICK_DZ        4
+#define REPEATS         1000
+#define START_MAX       (1 << 16)
+
+static int failures;
+
+static void fail(const char* what, int a, int b)
+{
+    if (failures++ < 10)
+        printf("FAIL: %s (%d, %d)\n", what, a, b);
+}
+
+// a short 2 finger flick, then the fling until it stops
+static void flick(ScrollSmoother& smoother, std::vector<int>& steps)
+{
+    steps.clear();
+    for (int i = 0; i < FLICK_NOTIFIES; i++)
+        smoother.filter(FLICK_DZ, (i + 1) * PACKET_NS);
+    steps.push_back(smoother.stop());
+    int step;
+    while ((step = smoother.getFlingDelta()) > 0)
+    {
+        steps.push_back(step);
+        if (steps.size() > 1000)
+            break;
+    }
+    if (smoother.isFlinging())
+        fail("still flinging after the last step", step, (int)steps.size());
+}
+
+static void new_smoother(ScrollSmoother& smoother)
+{
+    smoother.setHistoryDepth(8);
+    smoother.setFlingInterval(FLING_NS);
+}
+
+static void test_golden()
+{
+    // FLICK_DZ per notify over 5 intervals is 20*32 units in 62.5 ms,
+    // 204 per 20 ms tick; then *60/100 each tick, truncated
+    static const int golden[] = { 204, 122, 73, 43, 25, 15, 9, 5, 3, 1 };
+    const int count = sizeof(golden) / sizeof(golden[0]);
+    ScrollSmoother smoother;
+    new_smoother(smoother);
+    std::vector<int> steps;
+    flick(smoother, steps);
+    if ((int)steps.size() != count)
+        fail("golden step count", (int)steps.size(), count);
+    for (int i = 0; i < count && i < (int)steps.size(); i++)
+    {
+        if (steps[i] != golden[i])
+            fail("golden step", steps[i], golden[i]);
+    }
+}
+
+static void test_repeat()
+{
+    ScrollSmoother first, reused;
+    new_smoother(first);
+    new_smoother(reused);
+    std::vector<int> expect, steps;
+    flick(first, expect);
+    for (int n = 0; n < REPEATS; n++)
+    {
+        ScrollSmoother fresh;
+        new_smoother(fresh);
+        flick(fresh, steps);
+        if (steps != expect)
+            fail("fresh smoother differs on run", n, (int)steps.size());
+        flick(reused, steps);
+        if (steps != expect)
+            fail("reused smoother differs on run", n, (int)steps.size());
+    }
+}
+
+// stopDelta can only be set through stop(); a flick of one notify pair
+// one fling interval apart starts the fling at z*SCROLL_DELTA_FACTOR
+static int start_fling(ScrollSmoother& smoother, int z)
+{
+    smoother.filter(0, FLING_NS);
+    smoother.filter(z, 2 * FLING_NS);
+    return smoother.stop();
+}
+
+static void test_recurrence()
+{
+    static const int ratios[][2] = { { 60, 100 }, { 0, 1 }, { 1, 2 }, { 99, 100 }, { 3, 4 }, { 255, 256 } };
+    static const int thresholds[] = { 0, 1, 32, 200 };
+    for (size_t r = 0; r < sizeof(ratios) / sizeof(ratios[0]); r++)
+    {
+        for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++)
+        {
+            int multiplier = ratios[r][0], divisor = ratios[r][1], threshold = thresholds[t];
+            for (int z = 1; z <= START_MAX / SCROLL_DELTA_FACTOR; z++)
+            {
+                ScrollSmoother smoother;
+                new_smoother(smoother);
+                if (!smoother.setFlingDecay(multiplier, divisor, threshold))
+                    fail("valid ratio refused", multiplier, divisor);
+                int start = start_fling(smoother, z);
+                if (start != z * SCROLL_DELTA_FACTOR)
+                    fail("fling start", start, z * SCROLL_DELTA_FACTOR);
+                int delta = start;
+                int steps = 0;
+                for (;;)
+                {
+                    if (smoother.isFlinging() != (delta > threshold))
+                        fail("isFlinging disagrees with the delta", delta, threshold);
+                    int step = smoother.getFlingDelta();
+                    int expect = 0;
+                    if (delta > threshold)
+                    {
+                        expect = (int)((int64_t)delta * multiplier / divisor);
+                        if (expect <= threshold)
+                            expect = 0;
+                    }
+                    if (step != expect)
+                        fail("step is not delta*multiplier/divisor", step, expect);
+                    if (step <= 0)
+                        break;
+                    delta = step;
+                    // a ratio below 1 takes at least 1 off every step
+                    if (++steps > start)
+                    {
+                        fail("fling does not stop", start, multiplier);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void test_config()
+{
+    static const int refused[][2] = { { 100, 100 }, { 101, 100 }, { 1, 0 }, { 1, -1 }, { -1, 100 } };
+    for (size_t i = 0; i < sizeof(refused) / sizeof(refused[0]); i++)
+    {
+        ScrollSmoother smoother, reference;
+        new_smoother(smoother);
+        new_smoother(reference);
+        if (smoother.setFlingDecay(refused[i][0], refused[i][1], 0))
+            fail("ratio that does not decay accepted", refused[i][0], refused[i][1]);
+        reference.setFlingDecay(kFSPFlingMultiplier, kFSPFlingDivisor, 0);
+        std::vector<int> a, b;
+        flick(smoother, a);
+        flick(reference, b);
+        if (a != b)
+            fail("refused ratio not replaced by the default", refused[i][0], refused[i][1]);
+    }
+    // a negative threshold is no threshold
+    ScrollSmoother smoother, reference;
+    new_smoother(smoother);
+    new_smoother(reference);
+    smoother.setFlingDecay(kFSPFlingMultiplier, kFSPFlingDivisor, -5);
+    std::vector<int> a, b;
+    flick(smoother, a);
+    flick(reference, b);
+    if (a != b)
+        fail("negative threshold changed the fling", (int)a.size(), (int)b.size());
+}
+
+int main()
+{
+    test_golden();
+    test_repeat();
+    test_recurrence();
+    test_config();
+    if (failures)
+    {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("fsp_fling_test passed\n");
+    return 0;
+}
@@ -0,0 +1,260 @@
+//
+//  fsp_fuzz.cpp
+//
+//  Feeds byte streams through the path of the driver's interruptOccurred and
+//  packetReady: fsp_assemble_byte, then for every packet it completes
+//  fsp_decode_packet, the finger tracker, the abs filter and the gesture
+//  table.  After every byte it checks that the assembler stays inside the
+//  packet, that completed packets are plausible, and that a packet's start
+//  time is the arrival of its own byte 0 (the index of the byte in the
+//  stream is used as its time).
+//
+//  LLVMFuzzerTestOneInput is the libFuzzer entry point; the first byte of
+//  the input picks the packet size and whether it changes halfway through,
+//  as it does when the driver switches packet mode.  Built without
+//  FSP_LIBFUZZER, main runs three streams and reports bytes/sec for each:
+//
+//    random      uniformly random bytes, packet size switching now and then
+//    log         the packets of a testdata log, back to back
+//    damaged     the same packets with bytes dropped, duplicated and
+//                replaced at random; reports how many packets survive
+//
+//  usage: fsp_fuzz [testdata] [megabytes]
+//
+
+#include "fsp_testdata.h"
+#include "VoodooPS2SentelicFSPDecoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the driver's two packet modes
+#define PACKET_STANDARD     3
+#define PACKET_LARGE        FSP_PACKET_MAX
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct Pipeline
+{
+    FSPAssembler     assembler;
+    uint8_t          packet[FSP_PACKET_MAX];
+    FSPFingerTracker fingers;
+    FSPAbsFilter     abs;
+    uint32_t         packets;
+    uint32_t         dropped;
+    int              sink;          // keeps the decode from being optimized away
+};
+
+static void pipeline_reset(Pipeline* p)
+{
+    memset(p, 0, sizeof(*p));
+    fsp_assembler_reset(&p->assembler);
+    fsp_tracker_reset(&p->fingers);
+    fsp_abs_reset(&p->abs);
+}
+
+static void fail(const char* what, size_t index)
+{
+    fprintf(stderr, "byte %zu: %s\n", index, what);
+    abort();
+}
+
+// what packetReady does with a packet, minus the events
+static void dispatch(Pipeline* p, const uint8_t packet[FSP_PACKET_MAX])
+{
+    FSPPacket fsp;
+    fsp_decode_packet(packet, &fsp);
+    fsp_tracker_update(&p->fingers, &fsp);
+    int dx = 0, dy = 0;
+    switch (fsp.type)
+    {
+        case FSP_PKT_TYPE_ABS:
+            if (fsp.multiCoord)
+                fsp_tracker_two_finger_motion(&p->fingers, &dx, &dy);
+            else if (fsp.absX == 0 && fsp.absY == 0)
+                fsp_abs_reset(&p->abs);
+            else
+                fsp_abs_motion(&p->abs, fsp.absX, fsp.absY, &dx, &dy);
+            break;
+        case FSP_PKT_TYPE_NOTIFY:
+            if (fsp.notifyType == FSP_CX_NOTIFY_MSG_TYPE_GUESTURE)
+            {
+                const FSPGestureEntry& gesture = fsp_gesture_table[fsp.gestureId];
+                dx = gesture.action + gesture.arg;
+                dy = fsp_get_guesture_name_by_id(fsp.gestureId)[0];
+            }
+            break;
+        default:
+            dx = fsp.dx;
+            dy = fsp.dy;
+            break;
+    }
+    p->sink += dx + dy + fsp.buttons;
+}
+
+// one byte as interruptOccurred sees it; index is the byte's arrival time
+static void feed(Pipeline* p, const uint8_t* stream, size_t index, int packetSize)
+{
+    uint32_t resyncs = p->assembler.resyncs;
+    int result = fsp_assemble_byte(&p->assembler, p->packet, packetSize, stream[index], index);
+    if (p->assembler.count < 0 || p->assembler.count >= packetSize)
+        fail("fragment outside the packet", index);
+    if (p->assembler.resyncs < resyncs)
+        fail("resync count went back", index);
+    switch (result)
+    {
+        case kFSPAssembleDropped:
+            ++p->dropped;
+            break;
+        case kFSPAssembleReady:
+            if (!fsp_packet_plausible(p->packet))
+                fail("implausible packet completed", index);
+            if (p->assembler.start > index || stream[p->assembler.start] != p->packet[0])
+                fail("start time is not byte 0's", index);
+            ++p->packets;
+            dispatch(p, p->packet);
+            break;
+        case kFSPAssembleBuffering:
+        case kFSPAssembleResync:
+            break;
+        default:
+            fail("unknown result", index);
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (size < 1)
+        return 0;
+    static bool initialized;
+    if (!initialized)
+    {
+        fsp_gesture_table_init();
+        initialized = true;
+    }
+    Pipeline p;
+    pipeline_reset(&p);
+    int packetSize = data[0] & 1 ? PACKET_LARGE : PACKET_STANDARD;
+    for (size_t i = 1; i < size; i++)
+    {
+        if ((data[0] & 2) && i == size / 2)
+            packetSize = PACKET_LARGE + PACKET_STANDARD - packetSize;
+        feed(&p, data, i, packetSize);
+    }
+    return 0;
+}
+
+#ifndef FSP_LIBFUZZER
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static uint32_t rng_state = 0x2545f491;
+
+static inline uint32_t rng()
+{
+    // xorshift32, the same streams on every run
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void report(const char* name, const Pipeline& p, size_t bytes, uint64_t ns)
+{
+    printf("%-8s %9zu bytes, %8u packets, %7u resyncs, %9u dropped: %.1f MB/s\n",
+           name, bytes, p.packets, p.assembler.resyncs, p.dropped,
+           ns ? (double)bytes * 1000 / ns : 0.0);
+}
+
+static uint64_t run(Pipeline* p, const std::vector<uint8_t>& stream, const std::vector<uint8_t>* sizes)
+{
+    uint64_t start = fsp_now_ns();
+    for (size_t i = 0; i < stream.size(); i++)
+        feed(p, stream.data(), i, sizes ? (*sizes)[i] : PACKET_LARGE);
+    return fsp_now_ns() - start;
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : FSP_TESTDATA_DEFAULT;
+    size_t bytes = (argc > 2 ? atoi(argv[2]) : 16) * 1000000UL;
+    std::vector<FSPTestPacket> packets;
+    if (!fsp_read_testdata(path, packets))
+        return 1;
+    fsp_gesture_table_init();
+    Pipeline p;
+
+    // random bytes, switching packet size about every 64k bytes
+    std::vector<uint8_t> stream(bytes), sizes(bytes);
+    int packetSize = PACKET_LARGE;
+    for (size_t i = 0; i < bytes; i++)
+    {
+        if (!(rng() & 0xffff))
+            packetSize = PACKET_LARGE + PACKET_STANDARD - packetSize;
+        stream[i] = (uint8_t)rng();
+        sizes[i] = packetSize;
+    }
+    pipeline_reset(&p);
+    report("random", p, bytes, run(&p, stream, &sizes));
+
+    // the log, repeated
+    stream.clear();
+    while (stream.size() < bytes)
+        for (size_t i = 0; i < packets.size(); i++)
+            stream.insert(stream.end(), packets[i].bytes, packets[i].bytes + FSP_PACKET_MAX);
+    size_t sent = stream.size() / FSP_PACKET_MAX;
+    pipeline_reset(&p);
+    uint64_t ns = run(&p, stream, NULL);
+    report("log", p, stream.size(), ns);
+    if (p.packets != sent || p.assembler.resyncs)
+    {
+        printf("clean stream lost packets: %u of %zu, %u resyncs\n",
+               p.packets, sent, p.assembler.resyncs);
+        return 1;
+    }
+
+    // the log with about one byte in 200 dropped, duplicated or replaced
+    std::vector<uint8_t> damaged;
+    damaged.reserve(stream.size());
+    for (size_t i = 0; i < stream.size(); i++)
+    {
+        switch (rng() % 600)
+        {
+            case 0:
+                break;
+            case 1:
+                damaged.push_back(stream[i]);
+                damaged.push_back(stream[i]);
+                break;
+            case 2:
+                damaged.push_back((uint8_t)rng());
+                break;
+            default:
+                damaged.push_back(stream[i]);
+                break;
+        }
+    }
+    pipeline_reset(&p);
+    report("damaged", p, damaged.size(), run(&p, damaged, NULL));
+    printf("damaged: %u of %zu packets completed (%.1f%%)\n",
+           p.packets, sent, p.packets * 100.0 / sent);
+
+    // short inputs the way libFuzzer sends them: pieces of the damaged log
+    // cut at any byte, with a random first byte for the packet size
+    const int inputs = 100000;
+    uint8_t input[64];
+    for (int n = 0; n < inputs; n++)
+    {
+        size_t size = rng() % sizeof(input);
+        size_t from = rng() % (damaged.size() - size);
+        memcpy(input, &damaged[from], size);
+        if (size)
+            input[0] = (uint8_t)rng();
+        LLVMFuzzerTestOneInput(input, size);
+    }
+    printf("%d truncated inputs passed\n", inputs);
+    return 0;
+}
+
+#endif // FSP_LIBFUZZER
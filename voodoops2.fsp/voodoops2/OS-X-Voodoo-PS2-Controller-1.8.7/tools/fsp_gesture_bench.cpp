@@ -0,0 +1,241 @@
+//
+//  fsp_gesture_bench.cpp
+//
+//  Runs every gesture ID through fsp_gesture_table and through a copy of the
+//  switch the driver used before it, both from the start of a gesture and
+//  in the middle of one.  Lists the IDs where the two disagree, then times
+//  both.  The palm ID (0x38) only differs in state the table path keeps for
+//  palm rejection, which this does not compare.
+//
+//  usage: fsp_gesture_bench [passes]
+//
+
+#include "fsp_testdata.h"
+#include "VoodooPS2SentelicFSPDecoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// what one notify made the driver do
+struct Effects
+{
+    int scrolls;        // dispatchScrollWheelEventX
+    int scrollDir;      // FSP_SCROLL_* of the last one, 0 if none
+    int messages;       // dispatchKeyboardMessage
+    int clicks;         // synthesized right clicks
+    int lastMessage;    // FSPGestureMessage of the last one, -1 if none
+};
+
+static inline void scroll(Effects* e, int dir)
+{
+    ++e->scrolls;
+    e->scrollDir = dir;
+}
+
+static inline void message(Effects* e, int m)
+{
+    ++e->messages;
+    e->lastMessage = m;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// The switch of the baseline driver, case for case and fall through for fall
+// through, with each dispatch replaced by a count.  Scrolls are counted as
+// if the filtered delta was positive (the only case they were dispatched).
+//
+
+static void switch_dispatch(uint8_t id, bool* inGesture, Effects* e)
+{
+    bool& _isInGesture = *inGesture;
+    switch (id) {
+        case	0x86:
+              _isInGesture=true;
+            scroll(e, FSP_SCROLL_UP);
+            break;
+        case	0x82:
+            
+            _isInGesture=true;
+            scroll(e, FSP_SCROLL_DOWN);
+            break;
+        case	0x80:
+              _isInGesture=true;
+            scroll(e, FSP_SCROLL_RIGHT);
+            break;
+        case	0x84:
+              _isInGesture=true;
+            scroll(e, FSP_SCROLL_LEFT);
+            break;
+        case	0x8f:
+            if(!_isInGesture)
+            {
+                _isInGesture=true;
+                message(e, kFSPMessageZoomIn);
+            }
+        case	0x8b:
+            if(!_isInGesture)
+            {
+                _isInGesture=true;
+                message(e, kFSPMessageZoomOut);
+            }
+        case	0xc0:
+            if(!_isInGesture)
+            {
+                _isInGesture=true;
+                message(e, kFSPMessageRotateL);
+            }
+        case	0xc4:
+            if(!_isInGesture)
+            {
+                _isInGesture=true;
+                message(e, kFSPMessageRotateR);
+            }
+        case	0x2e:
+            if(!_isInGesture)
+            {
+                _isInGesture=true;
+                message(e, kFSPMessageSwipeUp);
+            }
+        case	0x2a:
+            if(!_isInGesture)
+            {
+                 _isInGesture=true;
+                message(e, kFSPMessageSwipeDown);
+            }
+        case	0x28:
+            if(!_isInGesture)
+            {
+                _isInGesture=true;
+               message(e, kFSPMessageSwipeRight);
+            }
+        case	0x2c:
+            if(!_isInGesture)
+            {
+               _isInGesture=true;
+               message(e, kFSPMessageSwipeLeft);
+            }
+        case 0x18:
+            //3 fingers quick click ?
+            break;
+        case 0x19:
+            //3 fingers quick click
+
+            break;
+            
+        case 0x11:
+            //2 finger click
+            ++e->clicks;
+            break;
+            
+        case 0x1a:
+            //3 fingers double click
+            if(!_isInGesture)
+            {
+                 _isInGesture=true;
+                 message(e, kFSPMessageLaunchPad);
+            }
+            break;
+        case	0x38:
+            //palm
+            break;
+        case 0:
+            _isInGesture = false;
+            break;
+        default:
+            break;
+    }
+}
+
+// the driver's table path, ZoomRotateThreshold 0 (one message per gesture)
+static void table_dispatch(uint8_t id, bool* inGesture, Effects* e)
+{
+    const FSPGestureEntry& gesture = fsp_gesture_table[id];
+    switch (gesture.action) {
+        case kFSPGestureScroll:
+            *inGesture = true;
+            scroll(e, gesture.arg);
+            break;
+        case kFSPGestureMessage:
+        case kFSPGestureAccumulate:
+            if (!*inGesture)
+            {
+                *inGesture = true;
+                message(e, gesture.arg);
+            }
+            break;
+        case kFSPGestureRightClick:
+            ++e->clicks;
+            break;
+        case kFSPGestureEnd:
+            *inGesture = false;
+            break;
+        default:
+            break;
+    }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+typedef void (*Dispatch)(uint8_t id, bool* inGesture, Effects* e);
+
+static double time_dispatch(Dispatch dispatch, int passes, int* sink)
+{
+    Effects e = { 0, 0, 0, 0, -1 };
+    uint64_t start = fsp_now_ns();
+    for (int pass = 0; pass < passes; pass++)
+    {
+        for (int id = 0; id < 256; id++)
+        {
+            // every notify starts a gesture, the worst case for both
+            bool inGesture = false;
+            dispatch((uint8_t)id, &inGesture, &e);
+        }
+    }
+    uint64_t elapsed = fsp_now_ns() - start;
+    *sink += e.scrolls + e.messages + e.clicks;
+    return (double)elapsed / ((double)passes * 256);
+}
+
+int main(int argc, const char* argv[])
+{
+    int passes = argc > 1 ? atoi(argv[1]) : 100000;
+    if (passes < 1)
+        passes = 1;
+
+    fsp_gesture_table_init();
+
+    int errors = 0, differ = 0;
+    for (int state = 0; state < 2; state++)
+    {
+        for (int id = 0; id < 256; id++)
+        {
+            Effects s = { 0, 0, 0, 0, -1 }, t = { 0, 0, 0, 0, -1 };
+            bool sg = state, tg = state;
+            switch_dispatch((uint8_t)id, &sg, &s);
+            table_dispatch((uint8_t)id, &tg, &t);
+            if (t.messages > 1 || t.scrolls > 1)
+            {
+                printf("0x%02x: table sends %d messages, %d scrolls\n", id, t.messages, t.scrolls);
+                ++errors;
+            }
+            if (s.messages != t.messages || s.lastMessage != t.lastMessage ||
+                s.scrolls != t.scrolls || s.scrollDir != t.scrollDir ||
+                s.clicks != t.clicks || sg != tg)
+            {
+                printf("0x%02x %s%s: switch %d messages (last %d) %d scrolls (dir %d) %d clicks, "
+                       "table %d (last %d) %d (dir %d) %d clicks\n",
+                       id, fsp_get_guesture_name_by_id(id), state ? " in gesture" : "",
+                       s.messages, s.lastMessage, s.scrolls, s.scrollDir, s.clicks,
+                       t.messages, t.lastMessage, t.scrolls, t.scrollDir, t.clicks);
+                ++differ;
+            }
+        }
+    }
+    printf("%d of 512 ID/state pairs dispatched differently by the old switch\n", differ);
+
+    int sink = 0;
+    double sw = time_dispatch(switch_dispatch, passes, &sink);
+    double tb = time_dispatch(table_dispatch, passes, &sink);
+    printf("256 IDs x %d passes: switch %.2f ns/notify, table %.2f ns/notify (sink %d)\n",
+           passes, sw, tb, sink);
+    return errors || differ ? 1 : 0;
+}
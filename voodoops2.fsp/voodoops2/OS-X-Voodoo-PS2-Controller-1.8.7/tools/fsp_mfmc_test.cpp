@@ -0,0 +1,375 @@
+//
+//  fsp_mfmc_test.cpp
+//
+//  Feeds built packets through fsp_decode_packet and fsp_tracker_update and
+//  checks the tracker after each one:
+//
+//    enter/leave     0xb7 notifies switch MFMC on and off, take the finger
+//                    count from bits 5-4 and clear every finger
+//    interleave      finger 0 and finger 1 abs packets, each finger's delta
+//                    is against its own previous packet
+//    lift            a finger's 0/0 puts only that finger up; SFAC 0/0
+//                    puts every finger up and ends MFMC
+//    two finger      fsp_tracker_two_finger_motion only reports while both
+//                    fingers are down, and reports their average
+//    other packets   gesture notifies, SFAC motion and relative packets are
+//                    not part of the stream and leave the tracker alone
+//
+//  Then replays the abs packets of a log and checks the tracker against
+//  every decoded MFMC packet.
+//
+//  usage: fsp_mfmc_test [testdata]
+//
+
+#include "fsp_testdata.h"
+#include "VoodooPS2SentelicFSPDecoder.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static int failures;
+static int checks;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(bool ok, const char* what, int line)
+{
+    ++checks;
+    if (!ok && failures++ < 20)
+        printf("FAIL line %d: %s\n", line, what);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Packet builders, the bytes as the pad sends them.
+//
+
+static void mfmc_notify(uint8_t packet[4], bool enter, int fingers)
+{
+    packet[0] = (FSP_PKT_TYPE_NOTIFY << FSP_PKT_TYPE_SHIFT) | MFMT_LEFT_BTN_OPC | MFMT_PS2_SPECIFY;
+    packet[1] = FSP_CX_NOTIFY_MSG_TYPE_MFMC;
+    packet[2] = (uint8_t)((fingers << 4) | (enter ? 0x01 : 0x00));
+    packet[3] = 0;
+}
+
+static void gesture_notify(uint8_t packet[4], int id, int value)
+{
+    packet[0] = (FSP_PKT_TYPE_NOTIFY << FSP_PKT_TYPE_SHIFT) | MFMT_LEFT_BTN_OPC | MFMT_PS2_SPECIFY;
+    packet[1] = FSP_CX_NOTIFY_MSG_TYPE_GUESTURE;
+    packet[2] = (uint8_t)id;
+    packet[3] = (uint8_t)value;
+}
+
+static void abs_packet(uint8_t packet[4], bool multiCoord, int finger, int x, int y)
+{
+    packet[0] = (FSP_PKT_TYPE_ABS << FSP_PKT_TYPE_SHIFT) | MFMT_LEFT_BTN_OPC | MFMT_PS2_SPECIFY;
+    if (multiCoord)
+        packet[0] |= MFMT_COORD_MODE;
+    if (finger)
+        packet[0] |= MFMT_FINGER_INDEX;
+    packet[1] = (uint8_t)(x >> 2);
+    packet[2] = (uint8_t)(y >> 2);
+    packet[3] = (uint8_t)(((x & 0x03) << 2) | (y & 0x03));
+}
+
+static void rel_packet(uint8_t packet[4], int dx, int dy)
+{
+    packet[0] = (FSP_PKT_TYPE_NORMAL << FSP_PKT_TYPE_SHIFT) | MFMT_PS2_SPECIFY;
+    if (dx < 0)
+        packet[0] |= 0x10;
+    if (dy > 0)
+        packet[0] |= 0x20;
+    packet[1] = (uint8_t)dx;
+    packet[2] = (uint8_t)-dy;
+    packet[3] = 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static bool feed(FSPFingerTracker* tracker, const uint8_t packet[4])
+{
+    FSPPacket fsp;
+    fsp_decode_packet(packet, &fsp);
+    return fsp_tracker_update(tracker, &fsp);
+}
+
+static bool enter(FSPFingerTracker* t, int fingers)
+{
+    uint8_t p[4];
+    mfmc_notify(p, true, fingers);
+    return feed(t, p);
+}
+
+static bool leave(FSPFingerTracker* t, int fingers)
+{
+    uint8_t p[4];
+    mfmc_notify(p, false, fingers);
+    return feed(t, p);
+}
+
+static bool finger(FSPFingerTracker* t, int index, int x, int y)
+{
+    uint8_t p[4];
+    abs_packet(p, true, index, x, y);
+    return feed(t, p);
+}
+
+static bool sfac(FSPFingerTracker* t, int x, int y)
+{
+    uint8_t p[4];
+    abs_packet(p, false, 0, x, y);
+    return feed(t, p);
+}
+
+static bool all_up(const FSPFingerTracker* t)
+{
+    for (int i = 0; i < FSP_MAX_FINGERS; i++)
+    {
+        const FSPFinger& f = t->finger[i];
+        if (f.down || f.x || f.y || f.dx || f.dy)
+            return false;
+    }
+    return true;
+}
+
+static bool same(const FSPFingerTracker* a, const FSPFingerTracker* b)
+{
+    if (a->active != b->active || a->count != b->count)
+        return false;
+    for (int i = 0; i < FSP_MAX_FINGERS; i++)
+    {
+        const FSPFinger& f = a->finger[i];
+        const FSPFinger& g = b->finger[i];
+        if (f.down != g.down || f.x != g.x || f.y != g.y || f.dx != g.dx || f.dy != g.dy)
+            return false;
+    }
+    return true;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void test_enter_leave()
+{
+    FSPFingerTracker t;
+    fsp_tracker_reset(&t);
+    CHECK(!t.active && t.count == 0 && all_up(&t));
+
+    // every finger count, with and without the other bits of byte 2 set
+    for (int fingers = 0; fingers < 4; fingers++)
+    {
+        CHECK(enter(&t, fingers));
+        CHECK(t.active && t.count == fingers && all_up(&t));
+        CHECK(leave(&t, fingers));
+        CHECK(!t.active && t.count == 0 && all_up(&t));
+        CHECK(enter(&t, fingers | 0x0c));
+        CHECK(t.active && t.count == fingers);
+    }
+
+    // entering again mid stream starts over
+    CHECK(enter(&t, 2));
+    CHECK(finger(&t, 0, 100, 200));
+    CHECK(finger(&t, 1, 300, 400));
+    CHECK(t.finger[0].down && t.finger[1].down);
+    CHECK(enter(&t, 3));
+    CHECK(t.active && t.count == 3 && all_up(&t));
+
+    // leaving clears fingers still down
+    CHECK(finger(&t, 0, 100, 200));
+    CHECK(leave(&t, 2));
+    CHECK(!t.active && t.count == 0 && all_up(&t));
+}
+
+static void test_interleave()
+{
+    FSPFingerTracker t;
+    fsp_tracker_reset(&t);
+    CHECK(enter(&t, 2));
+
+    // first packet of each finger: down, no delta
+    CHECK(finger(&t, 0, 500, 300));
+    CHECK(t.finger[0].down && t.finger[0].x == 500 && t.finger[0].y == 300);
+    CHECK(t.finger[0].dx == 0 && t.finger[0].dy == 0);
+    CHECK(!t.finger[1].down);
+    int dx = 99, dy = 99;
+    CHECK(!fsp_tracker_two_finger_motion(&t, &dx, &dy));
+    CHECK(dx == 99 && dy == 99);
+
+    CHECK(finger(&t, 1, 700, 310));
+    CHECK(t.finger[1].down && t.finger[1].x == 700 && t.finger[1].y == 310);
+    CHECK(t.finger[1].dx == 0 && t.finger[1].dy == 0);
+    CHECK(fsp_tracker_two_finger_motion(&t, &dx, &dy));
+    CHECK(dx == 0 && dy == 0);
+
+    // each finger moves against its own last position, not the other's
+    CHECK(finger(&t, 0, 504, 320));
+    CHECK(t.finger[0].dx == 4 && t.finger[0].dy == 20);
+    CHECK(t.finger[1].dx == 0 && t.finger[1].dy == 0);
+    CHECK(fsp_tracker_two_finger_motion(&t, &dx, &dy));
+    CHECK(dx == 2 && dy == 10);
+
+    CHECK(finger(&t, 1, 706, 331));
+    CHECK(t.finger[1].dx == 6 && t.finger[1].dy == 21);
+    CHECK(t.finger[0].dx == 4 && t.finger[0].dy == 20);
+    CHECK(fsp_tracker_two_finger_motion(&t, &dx, &dy));
+    CHECK(dx == 5 && dy == 20);
+
+    // the average truncates toward zero, also for negative motion
+    CHECK(finger(&t, 0, 501, 317));
+    CHECK(finger(&t, 1, 706, 331));
+    CHECK(fsp_tracker_two_finger_motion(&t, &dx, &dy));
+    CHECK(t.finger[0].dx == -3 && t.finger[0].dy == -3);
+    CHECK(dx == -1 && dy == -1);
+
+    // full 10-bit range
+    CHECK(finger(&t, 0, 1023, 1023));
+    CHECK(t.finger[0].x == 1023 && t.finger[0].y == 1023);
+    CHECK(t.finger[0].dx == 522 && t.finger[0].dy == 706);
+    CHECK(finger(&t, 0, 1, 1));
+    CHECK(t.finger[0].dx == -1022 && t.finger[0].dy == -1022);
+
+    // the same finger twice in a row
+    CHECK(finger(&t, 1, 710, 330));
+    CHECK(finger(&t, 1, 712, 329));
+    CHECK(t.finger[1].dx == 2 && t.finger[1].dy == -1);
+    CHECK(t.active && t.count == 2);
+}
+
+static void test_lift()
+{
+    FSPFingerTracker t;
+    fsp_tracker_reset(&t);
+    CHECK(enter(&t, 2));
+    CHECK(finger(&t, 0, 400, 400));
+    CHECK(finger(&t, 1, 600, 400));
+    CHECK(finger(&t, 0, 410, 400));
+    CHECK(finger(&t, 1, 610, 400));
+
+    // finger 1 up: only finger 1, and no two finger motion
+    CHECK(finger(&t, 1, 0, 0));
+    CHECK(!t.finger[1].down && t.finger[1].dx == 0 && t.finger[1].dy == 0);
+    CHECK(t.finger[0].down && t.finger[0].x == 410);
+    int dx, dy;
+    CHECK(!fsp_tracker_two_finger_motion(&t, &dx, &dy));
+    CHECK(t.active && t.count == 2);
+
+    // finger 0 keeps moving alone
+    CHECK(finger(&t, 0, 415, 398));
+    CHECK(t.finger[0].dx == 5 && t.finger[0].dy == -2);
+
+    // finger 1 comes back: a new touch, no delta against where it lifted
+    CHECK(finger(&t, 1, 900, 100));
+    CHECK(t.finger[1].down && t.finger[1].dx == 0 && t.finger[1].dy == 0);
+    CHECK(fsp_tracker_two_finger_motion(&t, &dx, &dy));
+    CHECK(dx == 2 && dy == -1);
+
+    // SFAC 0/0 puts every finger up and ends the stream
+    CHECK(sfac(&t, 0, 0));
+    CHECK(!t.active && t.count == 0 && all_up(&t));
+    // once more is not part of any stream
+    CHECK(!sfac(&t, 0, 0));
+    CHECK(!t.active && all_up(&t));
+
+    // an MFMC packet without an enter notify still starts tracking
+    CHECK(finger(&t, 0, 200, 200));
+    CHECK(t.active && t.count == 0 && t.finger[0].down);
+}
+
+static void test_other_packets()
+{
+    FSPFingerTracker t, before;
+    fsp_tracker_reset(&t);
+    CHECK(enter(&t, 2));
+    CHECK(finger(&t, 0, 400, 400));
+    CHECK(finger(&t, 1, 600, 400));
+    CHECK(finger(&t, 0, 410, 402));
+    before = t;
+
+    uint8_t p[4];
+    gesture_notify(p, 0x82, 0x1a);
+    CHECK(!feed(&t, p));
+    CHECK(same(&t, &before));
+    gesture_notify(p, 0x00, 0x00);
+    CHECK(!feed(&t, p));
+    CHECK(same(&t, &before));
+    CHECK(!sfac(&t, 512, 300));
+    CHECK(same(&t, &before));
+    rel_packet(p, 5, -3);
+    CHECK(!feed(&t, p));
+    CHECK(same(&t, &before));
+    rel_packet(p, -5, 3);
+    CHECK(!feed(&t, p));
+    CHECK(same(&t, &before));
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void test_log(const std::vector<FSPTestPacket>& packets)
+{
+    FSPFingerTracker t;
+    fsp_tracker_reset(&t);
+    int mfmc = 0, twoFinger = 0;
+    int lastX[FSP_MAX_FINGERS] = { 0 }, lastY[FSP_MAX_FINGERS] = { 0 };
+    bool wasDown[FSP_MAX_FINGERS] = { false };
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        FSPPacket fsp;
+        fsp_decode_packet(packets[i].bytes, &fsp);
+        bool part = fsp_tracker_update(&t, &fsp);
+        if (fsp.type != FSP_PKT_TYPE_ABS || !fsp.multiCoord)
+        {
+            // an MFMC notify or SFAC 0/0 put every finger up
+            if (part)
+                memset(wasDown, 0, sizeof(wasDown));
+            continue;
+        }
+        ++mfmc;
+        CHECK(part && t.active);
+        const FSPFinger& f = t.finger[fsp.finger];
+        if (fsp.absX == 0 && fsp.absY == 0)
+        {
+            CHECK(!f.down && f.dx == 0 && f.dy == 0);
+            wasDown[fsp.finger] = false;
+            continue;
+        }
+        CHECK(f.down && f.x == fsp.absX && f.y == fsp.absY);
+        CHECK(f.x == packets[i].absX || !packets[i].hasAbs);
+        if (wasDown[fsp.finger])
+            CHECK(f.dx == fsp.absX - lastX[fsp.finger] && f.dy == fsp.absY - lastY[fsp.finger]);
+        else
+            CHECK(f.dx == 0 && f.dy == 0);
+        wasDown[fsp.finger] = true;
+        lastX[fsp.finger] = fsp.absX;
+        lastY[fsp.finger] = fsp.absY;
+        int dx, dy;
+        if (fsp_tracker_two_finger_motion(&t, &dx, &dy))
+        {
+            ++twoFinger;
+            CHECK(dx == (t.finger[0].dx + t.finger[1].dx) / 2);
+            CHECK(dy == (t.finger[0].dy + t.finger[1].dy) / 2);
+        }
+        else
+            CHECK(!t.finger[0].down || !t.finger[1].down);
+    }
+    printf("log: %d MFMC packets, %d with both fingers down\n", mfmc, twoFinger);
+    CHECK(mfmc > 0 && twoFinger > 0);
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : FSP_TESTDATA_DEFAULT;
+    std::vector<FSPTestPacket> packets;
+    if (!fsp_read_testdata(path, packets))
+        return 1;
+
+    test_enter_leave();
+    test_interleave();
+    test_lift();
+    test_other_packets();
+    test_log(packets);
+    if (failures)
+    {
+        printf("%d of %d checks failed\n", failures, checks);
+        return 1;
+    }
+    printf("fsp_mfmc_test passed, %d checks\n", checks);
+    return 0;
+}
@@ -0,0 +1,87 @@
+//
+//  fsp_replay.cpp
+//
+//  Replays a packet log through the kext's decoder (fsp_packet_plausible,
+//  fsp_decode_packet, fsp_tracker_update), checks the decoded abs positions
+//  against the ones logged by the driver, then times the decode path.
+//
+//  usage: fsp_replay [testdata] [passes]
+//
+
+#include "fsp_testdata.h"
+#include "VoodooPS2SentelicFSPDecoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static int check(const std::vector<FSPTestPacket>& packets)
+{
+    int errors = 0;
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        const FSPTestPacket& p = packets[i];
+        if (!fsp_packet_plausible(p.bytes))
+        {
+            printf("packet %zu (%02x %02x %02x %02x) not plausible\n",
+                   i, p.bytes[0], p.bytes[1], p.bytes[2], p.bytes[3]);
+            ++errors;
+        }
+        if (!p.hasAbs)
+            continue;
+        FSPPacket fsp;
+        fsp_decode_packet(p.bytes, &fsp);
+        if (fsp.type != FSP_PKT_TYPE_ABS || fsp.absX != p.absX || fsp.absY != p.absY)
+        {
+            printf("packet %zu decoded as %d/%d, logged %d/%d\n",
+                   i, fsp.absX, fsp.absY, p.absX, p.absY);
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : FSP_TESTDATA_DEFAULT;
+    int passes = argc > 2 ? atoi(argv[2]) : 10000;
+    if (passes < 1)
+        passes = 1;
+
+    std::vector<FSPTestPacket> packets;
+    if (!fsp_read_testdata(path, packets))
+        return 1;
+
+    int errors = check(packets);
+    if (errors)
+    {
+        printf("%d decode errors\n", errors);
+        return 1;
+    }
+
+    // the work the kext does per packet before it gets to pointer events
+    FSPFingerTracker tracker;
+    fsp_tracker_reset(&tracker);
+    unsigned sink = 0;
+    uint64_t start = fsp_now_ns();
+    for (int pass = 0; pass < passes; pass++)
+    {
+        for (size_t i = 0; i < packets.size(); i++)
+        {
+            FSPPacket fsp;
+            if (!fsp_packet_plausible(packets[i].bytes))
+                continue;
+            fsp_decode_packet(packets[i].bytes, &fsp);
+            sink += fsp_tracker_update(&tracker, &fsp);
+            sink += fsp.type + fsp.buttons;
+        }
+    }
+    uint64_t elapsed = fsp_now_ns() - start;
+
+    uint64_t total = (uint64_t)passes * packets.size();
+    printf("%zu packets x %d passes: %.1f ns/packet, %.0f packets/sec (sink %u)\n",
+           packets.size(), passes, (double)elapsed / total,
+           total * 1e9 / (elapsed ? elapsed : 1), sink);
+    return 0;
+}
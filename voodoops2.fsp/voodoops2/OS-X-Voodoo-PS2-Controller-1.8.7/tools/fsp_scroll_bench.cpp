@@ -0,0 +1,376 @@
+//
+//  fsp_scroll_bench.cpp
+//
+//  Replays the 2 finger scroll gestures of a log through ScrollSmoother and
+//  through a copy of the smoother the driver used before it (no history,
+//  fling starts at the peak notify value and decays by a float 0.6).  The
+//  log has no timestamps, so packets are placed 12.5 ms apart (80 Hz), and
+//  again with up to 3 ms of jitter.  dz is worked out the way packetReady
+//  does it, including the absolute value of a gesture's first notify.
+//
+//  Only a short flick (fewer than 10 notifies) flings.  The recorded
+//  gestures are longer, so every gesture is also replayed cut off after 4
+//  to 9 notifies, as if the fingers had lifted there.  For each flick:
+//
+//    continuity  first fling step against the finger speed over the last 4
+//                notifies, both per 20 ms momentum tick; 1.0 is seamless
+//    smoothness  mean absolute second difference of the scroll output,
+//                summed into 20 ms ticks, through the scroll and the fling
+//
+//  It fails if the two smoothers' filter() outputs differ or if the new
+//  fling starts further from the finger speed than the old one.
+//
+//  usage: fsp_scroll_bench [testdata] [passes]
+//
+
+#include "fsp_testdata.h"
+#include "VoodooPS2SentelicFSPDecoder.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PACKET_NS       12500000ULL     // 80 packets/sec
+#define JITTER_NS       3000000ULL
+#define FLING_NS        20000000ULL     // momentumscrollInteval
+#define HISTORY_DEPTH   8               // ScrollHistoryDepth default
+#define SPEED_SAMPLES   4               // notifies the finger speed is taken over
+#define FLICK_MIN       SPEED_SAMPLES
+#define FLICK_MAX       9               // stop() flings below 10 notifies
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// The old smoother, as the driver had it; lastinputTime comes from the
+// caller instead of clock_get_uptime.
+//
+
+class OldSmoother
+{
+private:
+    uint64_t lastinputTime;
+    int  history[2];
+    int  lastDelta;
+    int  cur_history_index;
+    int  deltaDir;
+    int  inputCount;
+    int  stopDelta;
+    int  maxDelta;
+public:
+    OldSmoother() { memset(this, 0, sizeof(*this)); }
+    int filter(int z, uint64_t now);
+    int stop();
+    int getFlingDelta();
+};
+
+int OldSmoother::filter(int z, uint64_t now)
+{
+    if(z>0&& stopDelta>0)
+    {
+        stopDelta = 0;
+    }
+    if(cur_history_index>= (int)(sizeof(history)/sizeof(int)))
+    {
+        cur_history_index=0;
+    }
+    history[cur_history_index++] = z;
+    lastinputTime = now;
+    inputCount ++;
+    if(inputCount%2==1)
+    {
+        if(inputCount>2)
+            return lastDelta * SCROLL_DELTA_FACTOR;
+        else
+            return 0;
+    }
+    else
+    {
+        int dz = (history[1] + history[0])/2;
+        if(lastDelta > dz)
+            deltaDir = SCROLL_DELTA_DESCREASE;
+        else if(lastDelta<dz)
+            deltaDir = SCROLL_DELTA_INSCREASE;
+        else
+            deltaDir = SCROLL_DELTA_EVEN;
+        if(dz>maxDelta)
+        {
+            maxDelta  =z;
+        }
+        return dz* SCROLL_DELTA_FACTOR;
+    }
+}
+
+int OldSmoother::stop()
+{
+    if(lastinputTime!=0)
+    {
+        if(inputCount<10)
+        {
+            stopDelta = maxDelta*SCROLL_DELTA_FACTOR;
+        }
+        lastDelta = 0;
+        cur_history_index = 0 ;
+        lastinputTime = 0;
+        inputCount = 0;
+        maxDelta = 0;
+        memset(history, 0, sizeof(history));
+        return stopDelta;
+    }
+    return 0;
+}
+
+int OldSmoother::getFlingDelta()
+{
+    if(stopDelta>0)
+    {
+        stopDelta = stopDelta*0.6;
+        return stopDelta;
+    }
+    return 0;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct ScrollSample
+{
+    int      dz;        // what packetReady passes to filter()
+    int      z;         // the notify's cumulative value
+    uint64_t time;
+};
+
+typedef std::vector<ScrollSample> ScrollTrace;
+
+static uint32_t rng_state = 0x2545f491;
+
+static inline uint32_t rng()
+{
+    // xorshift32, the same jitter on every run
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+// the scroll gestures of a log, ended the way packetReady ends them
+static void find_traces(const std::vector<FSPTestPacket>& packets, bool jitter,
+                        std::vector<ScrollTrace>& traces)
+{
+    bool inGesture = false;
+    int lastZ = 0;
+    ScrollTrace trace;
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        uint64_t time = (i + 1) * PACKET_NS;
+        if (jitter)
+            time += rng() % JITTER_NS;
+        FSPPacket fsp;
+        fsp_decode_packet(packets[i].bytes, &fsp);
+        bool end = false;
+        if (fsp.type == FSP_PKT_TYPE_NOTIFY && fsp.notifyType == FSP_CX_NOTIFY_MSG_TYPE_GUESTURE)
+        {
+            int dz = inGesture ? fsp.gestureValue - lastZ : fsp.gestureValue;
+            lastZ = fsp.gestureValue;
+            const FSPGestureEntry& gesture = fsp_gesture_table[fsp.gestureId];
+            switch (gesture.action)
+            {
+                case kFSPGestureScroll:
+                {
+                    ScrollSample sample = { dz, fsp.gestureValue, time };
+                    inGesture = true;
+                    trace.push_back(sample);
+                    break;
+                }
+                case kFSPGestureMessage:
+                case kFSPGestureAccumulate:
+                    inGesture = true;
+                    break;
+                case kFSPGestureEnd:
+                    inGesture = false;
+                    end = true;
+                    break;
+                default:
+                    break;
+            }
+        }
+        else if (fsp.type == FSP_PKT_TYPE_NOTIFY)
+        {
+            inGesture = false;
+            end = true;
+        }
+        else if (fsp.type == FSP_PKT_TYPE_ABS && inGesture && fsp.absX == 0 && fsp.absY == 0)
+        {
+            inGesture = false;
+            end = true;
+        }
+        if (end && !trace.empty())
+        {
+            traces.push_back(trace);
+            trace.clear();
+        }
+    }
+    if (!trace.empty())
+        traces.push_back(trace);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct FlickResult
+{
+    double continuity;      // first fling step / finger speed
+    double smoothness;      // mean |second difference| per tick
+    bool   same;            // filter() outputs matched
+};
+
+// output of one flick summed into FLING_NS ticks; the fling takes one tick
+// per step from the tick after the last notify
+template <class Smoother>
+static void run_flick(Smoother& smoother, const ScrollTrace& trace, int count,
+                      std::vector<int>& outputs, std::vector<int>& ticks, int* firstFling)
+{
+    uint64_t origin = trace[0].time;
+    ticks.clear();
+    for (int i = 0; i < count; i++)
+    {
+        int out = smoother.filter(trace[i].dz, trace[i].time);
+        outputs.push_back(out);
+        size_t tick = (trace[i].time - origin) / FLING_NS;
+        if (ticks.size() <= tick)
+            ticks.resize(tick + 1, 0);
+        ticks[tick] += out;
+    }
+    *firstFling = 0;
+    if (smoother.stop() > 0)
+    {
+        int step;
+        while ((step = smoother.getFlingDelta()) > 0)
+        {
+            if (!*firstFling)
+                *firstFling = step;
+            ticks.push_back(step);
+        }
+    }
+}
+
+static double second_difference(const std::vector<int>& ticks)
+{
+    if (ticks.size() < 3)
+        return 0;
+    double sum = 0;
+    for (size_t i = 2; i < ticks.size(); i++)
+        sum += fabs((double)ticks[i] - 2.0 * ticks[i - 1] + ticks[i - 2]);
+    return sum / (ticks.size() - 2);
+}
+
+static void compare_flick(const ScrollTrace& trace, int count, FlickResult* old, FlickResult* now)
+{
+    OldSmoother a;
+    ScrollSmoother b;
+    b.setHistoryDepth(HISTORY_DEPTH);
+    b.setFlingInterval(FLING_NS);
+    std::vector<int> outA, outB, ticks;
+    int firstA, firstB;
+
+    // finger speed over the last SPEED_SAMPLES notifies, per fling tick
+    const ScrollSample& first = trace[count - SPEED_SAMPLES];
+    const ScrollSample& last = trace[count - 1];
+    double speed = (double)(last.z - first.z) * SCROLL_DELTA_FACTOR * FLING_NS / (last.time - first.time);
+
+    run_flick(a, trace, count, outA, ticks, &firstA);
+    old->smoothness = second_difference(ticks);
+    run_flick(b, trace, count, outB, ticks, &firstB);
+    now->smoothness = second_difference(ticks);
+    old->continuity = speed > 0 ? firstA / speed : 0;
+    now->continuity = speed > 0 ? firstB / speed : 0;
+    old->same = now->same = outA == outB;
+}
+
+// filter() cost over every sample of every trace, stop() and the fling left out
+template <class Smoother>
+static double time_filter(const std::vector<ScrollTrace>& traces, int passes, int* sink)
+{
+    uint64_t samples = 0;
+    uint64_t start = fsp_now_ns();
+    for (int p = 0; p < passes; p++)
+    {
+        Smoother smoother;
+        for (size_t t = 0; t < traces.size(); t++)
+        {
+            for (size_t i = 0; i < traces[t].size(); i++)
+                *sink += smoother.filter(traces[t][i].dz, traces[t][i].time);
+            samples += traces[t].size();
+            *sink += smoother.stop();
+        }
+    }
+    uint64_t ns = fsp_now_ns() - start;
+    return samples ? (double)ns / samples : 0;
+}
+
+static int report(const char* name, const std::vector<ScrollTrace>& traces)
+{
+    double contA = 0, contB = 0, errA = 0, errB = 0, smoothA = 0, smoothB = 0;
+    int flicks = 0, mismatches = 0;
+    for (size_t t = 0; t < traces.size(); t++)
+    {
+        for (int count = FLICK_MIN; count <= FLICK_MAX && count <= (int)traces[t].size(); count++)
+        {
+            FlickResult a, b;
+            compare_flick(traces[t], count, &a, &b);
+            if (!a.same)
+                ++mismatches;
+            contA += a.continuity;
+            contB += b.continuity;
+            errA += fabs(a.continuity - 1);
+            errB += fabs(b.continuity - 1);
+            smoothA += a.smoothness;
+            smoothB += b.smoothness;
+            ++flicks;
+        }
+    }
+    if (!flicks)
+    {
+        printf("%s: no flicks\n", name);
+        return 1;
+    }
+    printf("%-8s %d flicks   continuity old %.2f new %.2f (mean |1-x| %.2f / %.2f)   "
+           "smoothness old %.0f new %.0f\n",
+           name, flicks, contA / flicks, contB / flicks, errA / flicks, errB / flicks,
+           smoothA / flicks, smoothB / flicks);
+    if (mismatches)
+    {
+        printf("%s: filter() output differs in %d flicks\n", name, mismatches);
+        return 1;
+    }
+    if (errB > errA)
+    {
+        printf("%s: fling starts further from the finger speed than before\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : FSP_TESTDATA_DEFAULT;
+    int passes = argc > 2 ? atoi(argv[2]) : 200000;
+    std::vector<FSPTestPacket> packets;
+    if (!fsp_read_testdata(path, packets))
+        return 1;
+    fsp_gesture_table_init();
+
+    std::vector<ScrollTrace> traces, jittered;
+    find_traces(packets, false, traces);
+    find_traces(packets, true, jittered);
+    size_t samples = 0;
+    for (size_t t = 0; t < traces.size(); t++)
+        samples += traces[t].size();
+    printf("%zu scroll gestures, %zu notifies\n", traces.size(), samples);
+    if (traces.empty())
+        return 1;
+
+    int failed = report("80 Hz", traces) + report("jitter", jittered);
+
+    int sink = 0;
+    double nsA = time_filter<OldSmoother>(traces, passes, &sink);
+    double nsB = time_filter<ScrollSmoother>(traces, passes, &sink);
+    printf("filter: old %.2f ns/sample, new %.2f ns/sample (%d)\n", nsA, nsB, sink & 1);
+    return failed ? 1 : 0;
+}
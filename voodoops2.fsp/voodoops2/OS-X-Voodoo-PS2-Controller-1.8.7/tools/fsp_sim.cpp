@@ -0,0 +1,333 @@
+//
+//  fsp_sim.cpp
+//
+
+#include "fsp_sim.h"
+
+#include <string.h>
+
+enum
+{
+    kIdle,
+    kRate,          // f3 seen, parameter next
+    kKnock,         // f3 66 seen, 88 next
+    kReadAddr,      // read select seen, register next
+    kWriteAddr,     // write select seen, register next
+    kWriteF3,       // register latched, f3 for the value next
+    kWriteRate,     // f3 seen, value select next
+    kWriteValue     // value select seen, value next
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void respond(FSPSim* sim, uint8_t data)
+{
+    if (sim->outCount < (int)sizeof(sim->out))
+        sim->out[(sim->outHead + sim->outCount++) % sizeof(sim->out)] = data;
+}
+
+static bool is_rate(int val)
+{
+    return val == 10 || val == 20 || val == 40 || val == 60 || val == 80 || val == 100 || val == 200;
+}
+
+static bool is_reserved(int val)
+{
+    return val == 0xe9 || val == 0xee || val == 0xf2 || val == 0xff;
+}
+
+// undo fsp_mangle for one of the select triples (plain, swapped, inverted)
+static int unmangle(FSPSim* sim, int select, int plain, int swapped, int inverted, int data)
+{
+    int val;
+    if (select == swapped)
+        val = ((data >> 4) | (data << 4)) & 0xff;
+    else if (select == inverted)
+        val = ~data & 0xff;
+    else
+        val = data;
+    // sample rates must come swapped and reserved commands inverted, and
+    // nothing else may be mangled
+    int expected = is_rate(val) ? swapped : is_reserved(val) ? inverted : plain;
+    if (select != expected)
+        ++sim->protocolErrors;
+    return val;
+}
+
+static int reg_read(FSPSim* sim, int addr)
+{
+    if (addr == FSP_SIM_REG_PAGE_CTRL)
+        return sim->page;
+    return sim->regs[sim->page][addr];
+}
+
+static void reg_write(FSPSim* sim, int addr, int val)
+{
+    ++sim->writes;
+    if (addr == FSP_SIM_REG_PAGE_CTRL)
+    {
+        if (val < FSP_SIM_PAGES)
+            sim->page = val;
+        else
+            ++sim->protocolErrors;
+        return;
+    }
+    // identification registers are read only
+    if (addr == FSP_SIM_REG_DEVICE_ID || addr == FSP_SIM_REG_VERSION ||
+        addr == FSP_SIM_REG_REVISION || addr == FSP_SIM_REG_TMOD_STATUS1)
+        return;
+    sim->regs[sim->page][addr] = val;
+}
+
+static void command(FSPSim* sim, uint8_t data)
+{
+    switch (data)
+    {
+        case 0xf3:
+            // a knock stays armed for this one
+            sim->state = kRate;
+            respond(sim, 0xfa);
+            return;
+        case 0xe9:
+            // status request: the latched register goes out in the last byte
+            respond(sim, 0xfa);
+            respond(sim, 0x00);
+            respond(sim, 0x00);
+            respond(sim, sim->readAddr >= 0 ? reg_read(sim, sim->readAddr) : sim->rate);
+            if (sim->readAddr >= 0)
+                ++sim->reads;
+            sim->readAddr = -1;
+            return;
+        case 0x88:
+            // only valid as the middle of the read knock
+            ++sim->protocolErrors;
+            break;
+        case 0xf2:
+            sim->knocked = false;
+            respond(sim, 0xfa);
+            respond(sim, sim->id);
+            return;
+        case 0xf4:
+            sim->enabled = true;
+            break;
+        case 0xf5:
+            sim->enabled = false;
+            sim->rate = 100;
+            break;
+        case 0xf6:
+            sim->rate = 100;
+            break;
+    }
+    sim->knocked = false;
+    respond(sim, 0xfa);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+void fsp_sim_init(FSPSim* sim, uint8_t version, uint8_t revision, uint8_t tmod)
+{
+    memset(sim, 0, sizeof(*sim));
+    for (int page = 0; page < FSP_SIM_PAGES; page++)
+    {
+        sim->regs[page][FSP_SIM_REG_DEVICE_ID] = 0x01;
+        sim->regs[page][FSP_SIM_REG_VERSION] = version;
+        sim->regs[page][FSP_SIM_REG_REVISION] = revision;
+        sim->regs[page][FSP_SIM_REG_TMOD_STATUS1] = tmod;
+    }
+    sim->rate = 100;
+    sim->state = kIdle;
+    sim->readAddr = -1;
+}
+
+void fsp_sim_write(FSPSim* sim, uint8_t data)
+{
+    ++sim->bytesIn;
+    switch (sim->state)
+    {
+        case kIdle:
+            command(sim, data);
+            return;
+
+        case kRate:
+            if (sim->knocked)
+            {
+                sim->knocked = false;
+                if (data == 0x66 || data == 0xcc || data == 0x68)
+                {
+                    sim->select = data;
+                    sim->state = kReadAddr;
+                }
+                else
+                {
+                    ++sim->protocolErrors;
+                    sim->state = kIdle;
+                }
+            }
+            else if (data == 0x66)
+                sim->state = kKnock;
+            else if (data == 0x55 || data == 0x77 || data == 0x74)
+            {
+                sim->select = data;
+                sim->state = kWriteAddr;
+            }
+            else
+            {
+                sim->rate = data;
+                sim->rates[0] = sim->rates[1];
+                sim->rates[1] = sim->rates[2];
+                sim->rates[2] = data;
+                // the IntelliMouse Explorer knock
+                if (sim->rates[0] == 200 && sim->rates[1] == 200 && sim->rates[2] == 80)
+                    sim->id = 4;
+                sim->state = kIdle;
+            }
+            break;
+
+        case kKnock:
+            if (data == 0x88)
+                sim->knocked = true;
+            else
+                ++sim->protocolErrors;
+            sim->state = kIdle;
+            break;
+
+        case kReadAddr:
+            sim->readAddr = unmangle(sim, sim->select, 0x66, 0xcc, 0x68, data);
+            sim->state = kIdle;
+            break;
+
+        case kWriteAddr:
+            sim->writeAddr = unmangle(sim, sim->select, 0x55, 0x77, 0x74, data);
+            sim->state = kWriteF3;
+            break;
+
+        case kWriteF3:
+            if (data == 0xf3)
+                sim->state = kWriteRate;
+            else
+            {
+                ++sim->protocolErrors;
+                sim->state = kIdle;
+                command(sim, data);
+                return;
+            }
+            break;
+
+        case kWriteRate:
+            if (data == 0x33 || data == 0x44 || data == 0x47)
+            {
+                sim->select = data;
+                sim->state = kWriteValue;
+            }
+            else
+            {
+                ++sim->protocolErrors;
+                sim->state = kIdle;
+            }
+            break;
+
+        case kWriteValue:
+            reg_write(sim, sim->writeAddr, unmangle(sim, sim->select, 0x33, 0x44, 0x47, data));
+            sim->state = kIdle;
+            break;
+    }
+    respond(sim, 0xfa);
+}
+
+void fsp_sim_resend(FSPSim* sim)
+{
+    ++sim->bytesIn;
+    respond(sim, 0xfe);
+}
+
+int fsp_sim_read(FSPSim* sim)
+{
+    if (!sim->outCount)
+        return -1;
+    int data = sim->out[sim->outHead];
+    sim->outHead = (sim->outHead + 1) % sizeof(sim->out);
+    --sim->outCount;
+    ++sim->bytesOut;
+    return data;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Packets (see fsp-lnxdrv-code/doc/fsp_packet.txt): bits 7-6 of byte 0 are
+// the type, bit 3 is always set.  Abs packets carry x/y in bytes 1/2 and
+// their low 2 bits in byte 3, MFMC ones set bit 5 (and bit 2 for finger 1).
+// Notifies carry the message type in byte 1 and its parameters in 2 and 3.
+//
+
+static int abs_packet(uint8_t packet[4], bool multiCoord, int finger, int x, int y)
+{
+    packet[0] = 0x40 | 0x10 | 0x08;
+    if (multiCoord)
+        packet[0] |= 0x20;
+    if (finger)
+        packet[0] |= 0x04;
+    packet[1] = (uint8_t)(x >> 2);
+    packet[2] = (uint8_t)(y >> 2);
+    packet[3] = (uint8_t)(((x & 0x03) << 2) | (y & 0x03));
+    return 4;
+}
+
+static int notify_packet(uint8_t packet[4], uint8_t type, uint8_t id, uint8_t value)
+{
+    packet[0] = 0x80 | 0x10 | 0x08;
+    packet[1] = type;
+    packet[2] = id;
+    packet[3] = value;
+    return 4;
+}
+
+static int clamp(int v)
+{
+    return v < -255 ? -255 : v > 255 ? 255 : v;
+}
+
+int fsp_sim_packet(FSPSim* sim, const FSPSimEvent* event, uint8_t packet[4])
+{
+    if (!sim->enabled)
+        return 0;
+    int swreg1 = sim->regs[0][FSP_SIM_REG_SWREG1];
+    bool absolute = swreg1 & FSP_SIM_ABSOLUTE_MODE;
+    switch (event->type)
+    {
+        case kFSPSimTouch:
+        case kFSPSimTouch2:
+        {
+            bool two = event->type == kFSPSimTouch2;
+            if (two && !(swreg1 & FSP_SIM_2FINGERS_OUTPUT))
+            {
+                // without two finger output only finger 0 reports, as one finger
+                if (event->finger)
+                    return 0;
+                two = false;
+            }
+            if (absolute)
+                return abs_packet(packet, two, two ? event->finger : 0, event->x, event->y);
+            // relative: y grows downwards on the pad, upwards in PS/2
+            int dx = clamp(event->x - sim->x), dy = clamp(sim->y - event->y);
+            sim->x = event->x;
+            sim->y = event->y;
+            packet[0] = 0x08 | (dx < 0 ? 0x10 : 0) | (dy < 0 ? 0x20 : 0);
+            packet[1] = (uint8_t)dx;
+            packet[2] = (uint8_t)dy;
+            packet[3] = 0;
+            return sim->id == 4 ? 4 : 3;
+        }
+        case kFSPSimLift:
+            if (!absolute || !(swreg1 & FSP_SIM_FINGER_UP_OUTPUT))
+                return 0;
+            return abs_packet(packet, false, 0, 0, 0);
+        case kFSPSimFingers:
+            if (!absolute || !(swreg1 & FSP_SIM_2FINGERS_OUTPUT))
+                return 0;
+            return notify_packet(packet, 0xb7, (uint8_t)((event->value << 4) | (event->value ? 0x01 : 0x00)), 0);
+        case kFSPSimGesture:
+            if (!absolute || !(swreg1 & FSP_SIM_GESTURE_OUTPUT))
+                return 0;
+            return notify_packet(packet, 0xba, event->id, event->value);
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+//
+//  fsp_sim.h
+//
+//  Byte level model of a Sentelic FSP on the PS/2 mouse port: register file
+//  with page control (FSP_SIM_REG_PAGE_CTRL), the knock/select protocol of
+//  register reads and writes, and the value mangling.  The host side writes
+//  bytes with fsp_sim_write and collects the pad's responses with
+//  fsp_sim_read, as the controller's data port would.
+//
+//  Every byte is acknowledged with 0xfa.  A Status Request (0xe9) after a
+//  register read returns the register in its third byte.  Sequences the real
+//  pad would not understand, and mangled bytes that still collide with a
+//  sample rate or reserved command, count as protocol errors.
+//
+//  Enable (0xf4) and Set Defaults (0xf5/0xf6) start and stop reporting, and
+//  Get ID (0xf2) answers 4 once the sample rates 200, 200, 80 were set.
+//  fsp_sim_packet turns a scripted touch event into the packet the pad would
+//  report for it, in the format SWREG1 selects.
+//
+
+#ifndef _FSP_SIM_H
+#define _FSP_SIM_H
+
+#include <stdint.h>
+
+#define FSP_SIM_PAGES           4
+#define FSP_SIM_REG_DEVICE_ID   0x00
+#define FSP_SIM_REG_VERSION     0x01
+#define FSP_SIM_REG_REVISION    0x04
+#define FSP_SIM_REG_TMOD_STATUS1 0x0b
+#define FSP_SIM_REG_PAGE_CTRL   0x0f
+#define FSP_SIM_REG_SWREG1      0x90
+
+// SWREG1 bits fsp_sim_packet looks at
+#define FSP_SIM_ABSOLUTE_MODE   0x01
+#define FSP_SIM_GESTURE_OUTPUT  0x02
+#define FSP_SIM_2FINGERS_OUTPUT 0x04
+#define FSP_SIM_FINGER_UP_OUTPUT 0x08
+
+struct FSPSim
+{
+    uint8_t  regs[FSP_SIM_PAGES][256];
+    uint8_t  page;
+    uint8_t  rate;              // last plain sample rate
+    uint8_t  rates[3];          // the last three, oldest first
+    uint8_t  id;                // answer to Get ID
+    bool     enabled;           // reporting packets
+    int      x, y;              // last touch, for relative packets
+
+    // protocol state
+    int      state;
+    bool     knocked;           // f3 66, 88 seen; the next f3 selects a read
+    int      select;            // select byte of the access in progress
+    int      readAddr;          // latched by a read, returned by 0xe9
+    int      writeAddr;
+
+    // responses not yet read by the host
+    uint8_t  out[8];
+    int      outHead;
+    int      outCount;
+
+    uint32_t bytesIn;           // host to pad
+    uint32_t bytesOut;          // pad to host
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t protocolErrors;
+};
+
+// one step of a scripted touch
+enum FSPSimEventType
+{
+    kFSPSimTouch,           // one finger at x/y
+    kFSPSimTouch2,          // finger 0 or 1 of two at x/y (MFMC)
+    kFSPSimLift,            // all fingers up
+    kFSPSimFingers,         // MFMC notify, enter with value fingers, leave with 0
+    kFSPSimGesture          // gesture notify id/value
+};
+
+struct FSPSimEvent
+{
+    uint8_t  type;          // FSPSimEventType
+    int      x, y;          // 10 bit coordinates
+    uint8_t  finger;        // kFSPSimTouch2
+    uint8_t  id, value;     // kFSPSimGesture, value for kFSPSimFingers
+};
+
+void fsp_sim_init(FSPSim* sim, uint8_t version, uint8_t revision, uint8_t tmod);
+void fsp_sim_write(FSPSim* sim, uint8_t data);
+void fsp_sim_resend(FSPSim* sim);   // the pad missed a byte and answers 0xfe
+int  fsp_sim_read(FSPSim* sim);     // -1 if the pad has nothing to send
+int  fsp_sim_packet(FSPSim* sim, const FSPSimEvent* event, uint8_t packet[4]);
+
+#endif // _FSP_SIM_H
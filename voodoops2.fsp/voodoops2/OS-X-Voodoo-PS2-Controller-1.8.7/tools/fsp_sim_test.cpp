@@ -0,0 +1,154 @@
+//
+//  fsp_sim_test.cpp
+//
+//  Runs the register protocol of the decoder (fsp_reg_read_sequence,
+//  fsp_reg_write_sequence) against the simulated pad in fsp_sim.  The host
+//  side below sends the same bytes in the same order as the kext's
+//  fsp_append_reg_read/fsp_append_reg_write requests: one response read per
+//  byte, and for reads a Status Request whose third byte is the value.
+//
+//  Checks every register and value for round trips, the mangling of each
+//  byte on the wire, page control, and the bytes exchanged per operation
+//  against FSP_REG_READ_WIRE_BYTES/FSP_REG_WRITE_WIRE_BYTES.
+//
+
+#include "fsp_sim.h"
+#include "VoodooPS2SentelicFSPDecoder.h"
+
+#include <stdio.h>
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { if (!(cond)) { ++failures; printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); } } while (0)
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static bool send(FSPSim* sim, uint8_t data)
+{
+    fsp_sim_write(sim, data);
+    return fsp_sim_read(sim) >= 0;
+}
+
+static int sim_reg_read(FSPSim* sim, int reg)
+{
+    uint8_t sequence[FSP_REG_SEQUENCE_BYTES];
+    int count = fsp_reg_read_sequence(reg, sequence);
+    for (int i = 0; i < count; i++)
+        if (!send(sim, sequence[i]))
+            return -1;
+    fsp_sim_write(sim, 0xe9);
+    if (fsp_sim_read(sim) != 0xfa)
+        return -1;
+    fsp_sim_read(sim);
+    fsp_sim_read(sim);
+    return fsp_sim_read(sim);
+}
+
+static bool sim_reg_write(FSPSim* sim, int reg, int val)
+{
+    uint8_t sequence[FSP_REG_SEQUENCE_BYTES];
+    int count = fsp_reg_write_sequence(reg, val, sequence);
+    for (int i = 0; i < count; i++)
+        if (!send(sim, sequence[i]))
+            return false;
+    return true;
+}
+
+static uint32_t traffic(const FSPSim* sim)
+{
+    return sim->bytesIn + sim->bytesOut;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static void test_identification()
+{
+    FSPSim sim;
+    fsp_sim_init(&sim, 0xe1, 0x05, 0x20);
+    CHECK(sim_reg_read(&sim, FSP_SIM_REG_DEVICE_ID) == 0x01, "device ID");
+    CHECK(sim_reg_read(&sim, FSP_SIM_REG_VERSION) == 0xe1, "version");
+    CHECK(sim_reg_read(&sim, FSP_SIM_REG_REVISION) == 0x05, "revision");
+    CHECK(sim_reg_read(&sim, FSP_SIM_REG_TMOD_STATUS1) == 0x20, "tmod status");
+
+    // read only
+    sim_reg_write(&sim, FSP_SIM_REG_DEVICE_ID, 0x55);
+    CHECK(sim_reg_read(&sim, FSP_SIM_REG_DEVICE_ID) == 0x01, "device ID written");
+    CHECK(sim.protocolErrors == 0, "%u protocol errors", sim.protocolErrors);
+}
+
+static void test_round_trips()
+{
+    FSPSim sim;
+    fsp_sim_init(&sim, 0xe1, 0x05, 0x20);
+    for (int reg = 0x10; reg < 0x100; reg++)
+    {
+        for (int val = 0; val < 0x100; val++)
+        {
+            uint32_t before = traffic(&sim);
+            CHECK(sim_reg_write(&sim, reg, val), "write %02x", reg);
+            CHECK(traffic(&sim) - before == FSP_REG_WRITE_WIRE_BYTES,
+                  "write %02x=%02x took %u bytes", reg, val, traffic(&sim) - before);
+
+            before = traffic(&sim);
+            int got = sim_reg_read(&sim, reg);
+            CHECK(got == val, "reg %02x wrote %02x read %02x", reg, val, got);
+            CHECK(traffic(&sim) - before == FSP_REG_READ_WIRE_BYTES,
+                  "read %02x took %u bytes", reg, traffic(&sim) - before);
+        }
+    }
+    // every mangled register and value byte was checked by the model
+    CHECK(sim.protocolErrors == 0, "%u protocol errors", sim.protocolErrors);
+    printf("round trips: %u writes, %u reads, %u bytes\n", sim.writes, sim.reads, traffic(&sim));
+}
+
+static void test_pages()
+{
+    FSPSim sim;
+    fsp_sim_init(&sim, 0xe1, 0x05, 0x20);
+    sim_reg_write(&sim, 0x90, 0x11);
+    sim_reg_write(&sim, FSP_SIM_REG_PAGE_CTRL, 1);
+    CHECK(sim_reg_read(&sim, FSP_SIM_REG_PAGE_CTRL) == 1, "page select");
+    sim_reg_write(&sim, 0x90, 0x22);
+    CHECK(sim_reg_read(&sim, 0x90) == 0x22, "page 1 register");
+    sim_reg_write(&sim, FSP_SIM_REG_PAGE_CTRL, 0);
+    CHECK(sim_reg_read(&sim, 0x90) == 0x11, "page 0 register after page 1 write");
+    CHECK(sim.protocolErrors == 0, "%u protocol errors", sim.protocolErrors);
+}
+
+static void test_sample_rates()
+{
+    // the standard rates are plain sample rates, never part of a knock
+    static const int rates[] = { 10, 20, 40, 60, 80, 100, 200 };
+    FSPSim sim;
+    fsp_sim_init(&sim, 0xe1, 0x05, 0x20);
+    for (unsigned i = 0; i < sizeof(rates)/sizeof(rates[0]); i++)
+    {
+        send(&sim, 0xf3);
+        send(&sim, rates[i]);
+        send(&sim, 0xf4);
+        CHECK(sim.rate == rates[i], "rate %d", rates[i]);
+    }
+    CHECK(sim.protocolErrors == 0, "%u protocol errors", sim.protocolErrors);
+
+    // 0x66 is the read knock; anything but 0x88 after it is a broken sequence
+    send(&sim, 0xf3);
+    send(&sim, 0x66);
+    send(&sim, 0xf4);
+    CHECK(sim.protocolErrors == 1, "rate 0x66 not taken as a knock");
+}
+
+int main()
+{
+    test_identification();
+    test_round_trips();
+    test_pages();
+    test_sample_rates();
+    if (failures)
+    {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("fsp_sim_test passed\n");
+    return 0;
+}
@@ -0,0 +1,207 @@
+//
+//  fsp_subpixel.cpp
+//
+//  Compares fsp_abs_motion (fixed point average, remainders carried) with
+//  the truncating conversion the driver used before it, on the single finger
+//  abs packets of a log.  Both are measured against the exact (floating
+//  point) moving average of the same packets:
+//
+//    jitter      RMS and max distance between the pointer position the
+//                deltas add up to and the exact averaged position
+//    path        total length of the motion the deltas describe, against
+//                the length of the exact averaged path
+//
+//  fsp_abs_motion must stay within half a count of the exact path on each
+//  axis, and its path within PATH_ERROR_MAX percent of the exact length.
+//  Rounding halves the jitter but lengthens the path a little: every step
+//  is a whole count, so small wobbles the average smooths out still show
+//  up as steps.
+//
+//  usage: fsp_subpixel [testdata]
+//
+
+#include "fsp_testdata.h"
+#include "VoodooPS2SentelicFSPDecoder.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#define PATH_ERROR_MAX  1.0     // percent
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// The old conversion: deltas between truncated integer averages.
+//
+
+struct TruncAxis
+{
+    int sample[FSP_ABS_AVERAGE];
+    int count, index, sum;
+    int last;
+};
+
+struct TruncFilter
+{
+    bool      down;
+    TruncAxis x, y;
+};
+
+static int trunc_delta(TruncAxis* axis, int pos)
+{
+    axis->sum += pos;
+    if (axis->count == FSP_ABS_AVERAGE)
+        axis->sum -= axis->sample[axis->index];
+    else
+        ++axis->count;
+    axis->sample[axis->index] = pos;
+    if (++axis->index == FSP_ABS_AVERAGE)
+        axis->index = 0;
+    int avg = axis->sum / axis->count;
+    int d = avg - axis->last;
+    axis->last = avg;
+    return d;
+}
+
+static void trunc_motion(TruncFilter* filter, int absX, int absY, int* dx, int* dy)
+{
+    if (!filter->down)
+    {
+        filter->down = true;
+        filter->x.count = filter->x.index = filter->x.sum = 0;
+        filter->y.count = filter->y.index = filter->y.sum = 0;
+        filter->x.last = absX;
+        filter->y.last = absY;
+        *dx = *dy = 0;
+        return;
+    }
+    *dx = trunc_delta(&filter->x, absX);
+    *dy = trunc_delta(&filter->y, absY);
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct Stats
+{
+    double sq;          // sum of squared position errors
+    double max;         // largest position error
+    double path;        // length of the emitted path
+    long   samples;
+    long   zeroSteps;   // packets with exact motion but no delta
+};
+
+static void account(Stats* s, double ex, double ey, int dx, int dy, bool moved)
+{
+    double e = sqrt(ex * ex + ey * ey);
+    s->sq += e * e;
+    if (e > s->max)
+        s->max = e;
+    s->path += sqrt((double)dx * dx + (double)dy * dy);
+    ++s->samples;
+    if (moved && !dx && !dy)
+        ++s->zeroSteps;
+}
+
+static double path_error(const Stats& s, double refPath)
+{
+    return refPath ? (s.path - refPath) * 100 / refPath : 0.0;
+}
+
+static void report(const char* name, const Stats& s, double refPath)
+{
+    printf("%-10s jitter rms %.3f max %.3f counts, path %.1f (%+.2f%%), %ld stalled packets\n",
+           name, s.samples ? sqrt(s.sq / s.samples) : 0.0, s.max,
+           s.path, path_error(s, refPath), s.zeroSteps);
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : FSP_TESTDATA_DEFAULT;
+    std::vector<FSPTestPacket> packets;
+    if (!fsp_read_testdata(path, packets))
+        return 1;
+
+    FSPAbsFilter fixed;
+    TruncFilter  trunc;
+    fsp_abs_reset(&fixed);
+    trunc.down = false;
+
+    // exact average over the same window, and the positions the deltas reach
+    double window[2][FSP_ABS_AVERAGE];
+    int count = 0, index = 0;
+    double refX = 0, refY = 0, refPath = 0;
+    double fixedX = 0, fixedY = 0, truncX = 0, truncY = 0;
+    Stats fs = { 0, 0, 0, 0, 0 }, ts = { 0, 0, 0, 0, 0 };
+    int touches = 0;
+
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        FSPPacket fsp;
+        fsp_decode_packet(packets[i].bytes, &fsp);
+        if (fsp.type != FSP_PKT_TYPE_ABS || fsp.multiCoord)
+            continue;
+        if (fsp.absX == 0 && fsp.absY == 0)
+        {
+            fsp_abs_reset(&fixed);
+            trunc.down = false;
+            continue;
+        }
+
+        int fdx, fdy, tdx, tdy;
+        bool first = !fixed.down;
+        fsp_abs_motion(&fixed, fsp.absX, fsp.absY, &fdx, &fdy);
+        trunc_motion(&trunc, fsp.absX, fsp.absY, &tdx, &tdy);
+        if (first)
+        {
+            // touch down: everything starts at the raw position
+            ++touches;
+            count = index = 0;
+            refX = fixedX = truncX = fsp.absX;
+            refY = fixedY = truncY = fsp.absY;
+            continue;
+        }
+
+        window[0][index] = fsp.absX;
+        window[1][index] = fsp.absY;
+        if (++index == FSP_ABS_AVERAGE)
+            index = 0;
+        if (count < FSP_ABS_AVERAGE)
+            ++count;
+        double ax = 0, ay = 0;
+        for (int j = 0; j < count; j++)
+        {
+            ax += window[0][j];
+            ay += window[1][j];
+        }
+        ax /= count;
+        ay /= count;
+        bool moved = fabs(ax - refX) >= 1 || fabs(ay - refY) >= 1;
+        refPath += sqrt((ax - refX) * (ax - refX) + (ay - refY) * (ay - refY));
+        refX = ax;
+        refY = ay;
+
+        fixedX += fdx;
+        fixedY += fdy;
+        truncX += tdx;
+        truncY += tdy;
+        account(&fs, fixedX - refX, fixedY - refY, fdx, fdy, moved);
+        account(&ts, truncX - refX, truncY - refY, tdx, tdy, moved);
+    }
+
+    printf("%ld motion packets in %d touches, exact path %.1f counts\n", fs.samples, touches, refPath);
+    report("remainder", fs, refPath);
+    report("truncate", ts, refPath);
+
+    // rounded remainders keep each axis within half a count of the exact path
+    if (fs.max > sqrt(0.5) + 0.01)
+    {
+        printf("remainder conversion drifted %.3f counts\n", fs.max);
+        return 1;
+    }
+    // and must not trade that for a path noticeably longer than the finger's
+    if (fabs(path_error(fs, refPath)) > PATH_ERROR_MAX)
+    {
+        printf("remainder conversion path off by %+.2f%%, more than %.1f%%\n",
+               path_error(fs, refPath), PATH_ERROR_MAX);
+        return 1;
+    }
+    return 0;
+}
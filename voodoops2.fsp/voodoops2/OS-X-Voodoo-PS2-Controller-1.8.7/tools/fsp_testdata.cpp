@@ -0,0 +1,67 @@
+//
+//  fsp_testdata.cpp
+//
+
+#include "fsp_testdata.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+static bool parse_line(const char* line, FSPTestPacket* packet)
+{
+    // the packet bytes follow the last ": " before the first ';'
+    const char* end = strchr(line, ';');
+    if (!end)
+        return false;
+    const char* start = NULL;
+    for (const char* p = line; p < end; p++)
+        if (p[0] == ':' && p[1] == ' ')
+            start = p + 2;
+    if (!start)
+        return false;
+
+    unsigned b[4];
+    int used = 0;
+    if (sscanf(start, "%2x, %2x, %2x, %2x%n", &b[0], &b[1], &b[2], &b[3], &used) != 4 ||
+        start + used != end)
+        return false;
+    for (int i = 0; i < 4; i++)
+        packet->bytes[i] = (uint8_t)b[i];
+
+    packet->hasAbs = false;
+    const char* abs = strstr(end, "abs_x:");
+    if (abs && sscanf(abs, "abs_x: %d, abs_y: %d", &packet->absX, &packet->absY) == 2)
+        packet->hasAbs = true;
+    return true;
+}
+
+bool fsp_read_testdata(const char* path, std::vector<FSPTestPacket>& packets)
+{
+    FILE* file = fopen(path, "r");
+    if (!file)
+    {
+        perror(path);
+        return false;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), file))
+    {
+        FSPTestPacket packet;
+        if (parse_line(line, &packet))
+            packets.push_back(packet);
+    }
+    fclose(file);
+    if (packets.empty())
+        fprintf(stderr, "%s: no packets found\n", path);
+    return !packets.empty();
+}
+
+uint64_t fsp_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
@@ -0,0 +1,37 @@
+//
+//  fsp_testdata.h
+//
+//  Reader for the packet logs the driver's old fsp_packet_debug IOLog dump
+//  produced (testdataa.txt); packets are now traced with FSPTraceRing.
+//  Every line of the form
+//
+//      00000000: Absolute packet: 58, 89, 0f, 00;abs_x: 548, abs_y: 60,...
+//      00000009: 	2 finger straight down           : 98, ba, 82, 1a;...
+//
+//  yields one packet; anything else (notes, blank lines) is skipped.
+//
+
+#ifndef _FSP_TESTDATA_H
+#define _FSP_TESTDATA_H
+
+#include <stdint.h>
+#include <vector>
+
+struct FSPTestPacket
+{
+    uint8_t bytes[4];
+    bool    hasAbs;         // the log line carried abs_x/abs_y
+    int     absX;
+    int     absY;
+};
+
+// default location relative to tools/, see makefile
+#define FSP_TESTDATA_DEFAULT "../../testdataa.txt"
+
+// false if the file cannot be read or holds no packets
+bool fsp_read_testdata(const char* path, std::vector<FSPTestPacket>& packets);
+
+// monotonic clock in nanoseconds
+uint64_t fsp_now_ns();
+
+#endif // _FSP_TESTDATA_H
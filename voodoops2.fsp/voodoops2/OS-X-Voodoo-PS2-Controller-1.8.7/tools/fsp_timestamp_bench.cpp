@@ -0,0 +1,215 @@
+//
+//  fsp_timestamp_bench.cpp
+//
+//  Times the clock work of the driver's packet path, old against new, over
+//  the packets of a log:
+//
+//    old   every packet reads the clock (clock_get_uptime), converts it to
+//          nanoseconds for the maxaftertyping and scrolllockTime checks,
+//          and every scroll notify reads the clock again in
+//          ScrollSmoother::filter
+//    new   packetReady reads the clock once for the batch (_batchTime); the
+//          thresholds are in absolute time already, and a scroll notify
+//          takes its time from the packet (_packetTime)
+//
+//  Both do the same decode and tracker work, and must let the same packets
+//  through.  Batches of 1, 2, 4 and 8 packets are timed; at 80 packets/sec
+//  packetReady mostly sees 1.  fsp_now_ns (clock_gettime) stands in for
+//  clock_get_uptime, and the conversion is a call as on x86, where the
+//  timebase is 1/1.
+//
+//  interruptOccurred reading the clock for every byte (the packet start
+//  time used by the latency histogram and the scroll velocity) belongs to
+//  neither path; "new + bytes" adds it for reference.
+//
+//  usage: fsp_timestamp_bench [testdata] [passes]
+//
+
+#include "fsp_testdata.h"
+#include "VoodooPS2SentelicFSPDecoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BYTES_PER_PACKET    4
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// Host stand-ins for the kernel clock calls.
+//
+
+static volatile uint32_t timebase_numer = 1, timebase_denom = 1;
+
+static inline void clock_get_uptime(uint64_t* result)
+{
+    *result = fsp_now_ns();
+}
+
+__attribute__((noinline))
+static void absolutetime_to_nanoseconds(uint64_t abstime, uint64_t* result)
+{
+    uint32_t numer = timebase_numer, denom = timebase_denom;
+    *result = numer == denom ? abstime : abstime * numer / denom;
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+struct PathState
+{
+    FSPFingerTracker tracker;
+    uint64_t keytime;           // last key, ns for old, absolute for new
+    uint64_t gestureStopTime;
+    uint64_t maxaftertyping;
+    uint64_t scrolllockTime;
+    uint32_t dispatched;        // packets past the typing check
+    uint32_t scrollLocked;      // abs packets inside the scroll lock
+    uint64_t sink;
+};
+
+static void path_reset(PathState* s)
+{
+    fsp_tracker_reset(&s->tracker);
+    uint64_t now;
+    clock_get_uptime(&now);
+    // last key a second ago, last gesture now with a lock longer than the
+    // run: nothing is suppressed for typing, every abs packet is locked,
+    // the same for both paths however long the run takes
+    s->keytime = now - 1000000000ULL;
+    s->gestureStopTime = now;
+    s->maxaftertyping = 500000000ULL;
+    s->scrolllockTime = 3600000000000ULL;
+    s->dispatched = s->scrollLocked = 0;
+    s->sink = 0;
+}
+
+// the decode and tracker work both paths share
+static inline void decode(PathState* s, const uint8_t* bytes, FSPPacket* fsp)
+{
+    fsp_decode_packet(bytes, fsp);
+    s->sink += fsp_tracker_update(&s->tracker, fsp) + fsp->type;
+    ++s->dispatched;
+}
+
+static inline bool is_scroll(const FSPPacket& fsp)
+{
+    return fsp.type == FSP_PKT_TYPE_NOTIFY && fsp.notifyType == FSP_CX_NOTIFY_MSG_TYPE_GUESTURE &&
+           fsp_gesture_table[fsp.gestureId].action == kFSPGestureScroll;
+}
+
+static void old_batch(PathState* s, const FSPTestPacket* packets, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t now_abs, now_ns;
+        clock_get_uptime(&now_abs);
+        absolutetime_to_nanoseconds(now_abs, &now_ns);
+        if (now_ns - s->keytime < s->maxaftertyping)
+            continue;
+        FSPPacket fsp;
+        decode(s, packets[i].bytes, &fsp);
+        if (is_scroll(fsp))
+        {
+            uint64_t lastinputTime;
+            clock_get_uptime(&lastinputTime);
+            s->sink += lastinputTime & 1;
+        }
+        else if (fsp.type == FSP_PKT_TYPE_ABS && now_ns - s->gestureStopTime < s->scrolllockTime)
+            ++s->scrollLocked;
+    }
+}
+
+static void new_batch(PathState* s, const FSPTestPacket* packets, const uint64_t* starts, int count)
+{
+    uint64_t batchTime;
+    clock_get_uptime(&batchTime);
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t packetTime = starts[i] ? starts[i] : batchTime;
+        if (batchTime - s->keytime < s->maxaftertyping)
+            continue;
+        FSPPacket fsp;
+        decode(s, packets[i].bytes, &fsp);
+        if (is_scroll(fsp))
+            s->sink += packetTime & 1;
+        else if (fsp.type == FSP_PKT_TYPE_ABS && batchTime - s->gestureStopTime < s->scrolllockTime)
+            ++s->scrollLocked;
+    }
+}
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+enum { kOld, kNew, kNewBytes };
+
+static double run(int path, const std::vector<FSPTestPacket>& packets, int batch, int passes, PathState* s)
+{
+    path_reset(s);
+    uint64_t starts[8] = { 0 };
+    size_t total = 0;
+    uint64_t begin = fsp_now_ns();
+    for (int pass = 0; pass < passes; pass++)
+    {
+        for (size_t i = 0; i + batch <= packets.size(); i += batch)
+        {
+            switch (path)
+            {
+                case kOld:
+                    old_batch(s, &packets[i], batch);
+                    break;
+                case kNewBytes:
+                    // interruptOccurred: the time of every byte, the
+                    // packet keeps the one of its byte 0
+                    for (int p = 0; p < batch; p++)
+                    {
+                        for (int b = 0; b < BYTES_PER_PACKET; b++)
+                        {
+                            uint64_t time;
+                            clock_get_uptime(&time);
+                            if (!b)
+                                starts[p] = time;
+                        }
+                    }
+                    new_batch(s, &packets[i], starts, batch);
+                    break;
+                default:
+                    new_batch(s, &packets[i], starts, batch);
+                    break;
+            }
+            total += batch;
+        }
+    }
+    uint64_t ns = fsp_now_ns() - begin;
+    return total ? (double)ns / total : 0;
+}
+
+int main(int argc, const char* argv[])
+{
+    const char* path = argc > 1 ? argv[1] : FSP_TESTDATA_DEFAULT;
+    int passes = argc > 2 ? atoi(argv[2]) : 20000;
+    if (passes < 1)
+        passes = 1;
+    std::vector<FSPTestPacket> packets;
+    if (!fsp_read_testdata(path, packets))
+        return 1;
+    fsp_gesture_table_init();
+
+    int failed = 0;
+    static const int batches[] = { 1, 2, 4, 8 };
+    printf("%zu packets x %d passes, ns/packet\n", packets.size(), passes);
+    printf("batch       old       new  new + bytes\n");
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++)
+    {
+        PathState a, n, nb;
+        double nsOld = run(kOld, packets, batches[b], passes, &a);
+        double nsNew = run(kNew, packets, batches[b], passes, &n);
+        double nsBytes = run(kNewBytes, packets, batches[b], passes, &nb);
+        printf("%5d  %8.2f  %8.2f  %11.2f\n", batches[b], nsOld, nsNew, nsBytes);
+        if (a.dispatched != n.dispatched || a.scrollLocked != n.scrollLocked ||
+            n.dispatched != nb.dispatched || n.scrollLocked != nb.scrollLocked)
+        {
+            printf("batch %d: paths disagree, dispatched %u/%u/%u, scroll locked %u/%u/%u\n",
+                   batches[b], a.dispatched, n.dispatched, nb.dispatched,
+                   a.scrollLocked, n.scrollLocked, nb.scrollLocked);
+            failed = 1;
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,96 @@
+//
+//  ApplePS2MouseDevice.cpp (host)
+//
+//  ApplePS2Controller::processRequest for a port with an fsp_sim pad on it:
+//  the same commands, the same failures, and commandsCount left at the
+//  index of the command that failed.  Nothing is ever sent to a keyboard.
+//
+
+#include "ApplePS2MouseDevice.h"
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+
+bool ApplePS2MouseDevice::log = true;
+
+static void write_mouse(ApplePS2MouseDevice* device, UInt8 data)
+{
+    ++device->sent;
+    if (device->nakAt && device->sent >= device->nakAt && device->sent < device->nakAt + device->naks)
+    {
+        fsp_sim_resend(device->sim);
+        return;
+    }
+    fsp_sim_write(device->sim, data);
+}
+
+static UInt8 read_mouse(ApplePS2MouseDevice* device)
+{
+    int data = fsp_sim_read(device->sim);
+    if (data < 0)
+    {
+        // readDataPort gives up and returns 0
+        ++device->timeouts;
+        return 0;
+    }
+    return (UInt8)data;
+}
+
+void ApplePS2MouseDevice::submitRequestAndBlock(PS2Request* request)
+{
+    bool failed = false;
+    bool transmitToMouse = false;
+    unsigned index;
+    UInt8 byte;
+
+    ++requests;
+    for (index = 0; index < request->commandsCount; index++)
+    {
+        PS2Command& command = request->commands[index];
+        switch (command.command)
+        {
+            case kPS2C_ReadDataPort:
+            case kPS2C_ReadMouseDataPort:
+                command.inOrOut = read_mouse(this);
+                break;
+
+            case kPS2C_ReadDataPortAndCompare:
+            case kPS2C_ReadMouseDataPortAndCompare:
+                byte = read_mouse(this);
+                failed = (byte != command.inOrOut);
+                command.inOrOut = byte;
+                break;
+
+            case kPS2C_WriteDataPort:
+                // without kCP_TransmitToMouse first the byte is for the keyboard
+                failed = !transmitToMouse;
+                if (transmitToMouse)
+                    write_mouse(this, command.inOrOut);
+                transmitToMouse = false;
+                break;
+
+            case kPS2C_WriteCommandPort:
+                transmitToMouse = (command.inOrOut == kCP_TransmitToMouse);
+                break;
+
+            case kPS2C_SendMouseCommandAndCompareAck:
+                write_mouse(this, command.inOrOut);
+                failed = (read_mouse(this) != kSC_Acknowledge);
+                break;
+
+            case kPS2C_FlushDataPort:
+                command.inOrOut32 = 0;
+                while (fsp_sim_read(sim) >= 0)
+                    ++command.inOrOut32;
+                break;
+
+            case kPS2C_SleepMS:
+            case kPS2C_ModifyCommandByte:
+                break;
+        }
+        if (failed)
+            break;
+    }
+    if (failed)
+        ++this->failed;
+    request->commandsCount = index;
+}
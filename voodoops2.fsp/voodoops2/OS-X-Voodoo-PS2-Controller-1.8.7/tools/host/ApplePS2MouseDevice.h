@@ -0,0 +1,120 @@
+//
+//  ApplePS2MouseDevice.h (host)
+//
+//  Stand-in for VoodooPS2Controller/ApplePS2MouseDevice.h, for building
+//  VoodooPS2SentelicFSPRegisters.cpp on the host.  It has the PS2Request
+//  types and constants that file uses, and an ApplePS2MouseDevice whose
+//  submitRequestAndBlock runs the request on an fsp_sim pad the way
+//  ApplePS2Controller::processRequest runs it on the port.
+//
+//  Only the PS/2 transport is replaced; the register, identify and enable
+//  code is the driver's own.
+//
+
+#ifndef _APPLEPS2MOUSEDEVICE_H
+#define _APPLEPS2MOUSEDEVICE_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "fsp_sim.h"
+
+typedef uint8_t  UInt8;
+typedef uint16_t UInt16;
+typedef uint32_t UInt32;
+typedef int32_t  SInt32;
+
+#define IOLog(args...)      do { if (ApplePS2MouseDevice::log) printf(args); } while (0)
+#define DEBUG_LOG(args...)  do { } while (0)
+#define countof(x) (sizeof((x))/sizeof((x)[0]))
+
+uint64_t fsp_now_ns();
+
+static inline void clock_get_uptime(uint64_t* result)
+{
+    *result = fsp_now_ns();
+}
+
+static inline void absolutetime_to_nanoseconds(uint64_t abstime, uint64_t* result)
+{
+    *result = abstime;
+}
+
+#define kDP_GetMouseInformation        0xE9 // (mouse)
+#define kDP_GetId                      0xF2 // (keyboard+mouse)
+#define kDP_SetMouseSampleRate         0xF3 // (mouse)
+#define kDP_Enable                     0xF4 // (keyboard+mouse)
+#define kDP_SetDefaultsAndDisable      0xF5 // (keyboard+mouse)
+#define kDP_SetDefaults                0xF6 // (keyboard+mouse)
+
+#define kCP_TransmitToMouse            0xD4 // (mouse)
+
+#define kSC_Acknowledge         0xFA    // ack for transmitted commands
+#define kSC_Resend              0xFE    // request to resend keybd cmd
+
+enum PS2CommandEnum
+{
+  kPS2C_ReadDataPort,
+  kPS2C_ReadDataPortAndCompare,
+  kPS2C_WriteDataPort,
+  kPS2C_WriteCommandPort,
+  kPS2C_SendMouseCommandAndCompareAck,
+  kPS2C_ReadMouseDataPort,
+  kPS2C_ReadMouseDataPortAndCompare,
+  kPS2C_FlushDataPort,
+  kPS2C_SleepMS,
+  kPS2C_ModifyCommandByte,
+};
+
+struct PS2Command
+{
+  PS2CommandEnum command;
+  union
+  {
+      UInt8  inOrOut;
+      UInt32 inOrOut32;
+  };
+};
+
+#define kMaxCommands 30
+
+struct PS2Request
+{
+    UInt8               commandsCount;
+    PS2Command          commands[0];
+};
+
+template<int max = kMaxCommands> struct TPS2Request : public PS2Request
+{
+public:
+    PS2Command          commands[max];
+};
+
+// - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+// A mouse port with an fsp_sim pad on it.  nakAt makes the pad answer the
+// byte with that number (counted from 1 over bytes sent to the pad, resends
+// included), and the naks - 1 bytes after it, with 0xfe without taking
+// them, as a pad that missed them would.
+//
+
+class ApplePS2MouseDevice
+{
+public:
+    FSPSim*     sim;
+    int         nakAt;
+    int         naks;
+    int         sent;           // bytes sent to the pad
+    int         requests;       // submitRequestAndBlock calls
+    int         failed;         // requests that stopped early
+    int         timeouts;       // reads with nothing from the pad
+
+    ApplePS2MouseDevice(FSPSim* pad) : sim(pad), nakAt(0), naks(1), sent(0), requests(0), failed(0), timeouts(0) {}
+    void submitRequestAndBlock(PS2Request* request);
+
+    static bool log;            // IOLog to stdout
+};
+
+#endif /* !_APPLEPS2MOUSEDEVICE_H */